@@ -0,0 +1,59 @@
+/*=============================================================================
+
+   Name     : fmecityjsonbox.cpp
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Implementation of FMECityJSONBox
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+// Include Files
+#include "fmecityjsonbox.h"
+
+//===========================================================================
+void addBoundariesToBox(const json& boundaries,
+                        const FMECityJSONVertexPool& vertices,
+                        FMECityJSONBox& box)
+{
+   if (boundaries.is_array())
+   {
+      for (const auto& b : boundaries)
+      {
+         addBoundariesToBox(b, vertices, box);
+      }
+   }
+   else if (boundaries.is_number_integer() and boundaries.get<std::int64_t>() >= 0)
+   {
+      const std::size_t i = boundaries.get<std::size_t>();
+      if (i < vertices.size())
+      {
+         box.expand(vertices.x(i), vertices.y(i));
+      }
+   }
+}
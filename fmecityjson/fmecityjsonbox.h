@@ -0,0 +1,89 @@
+#ifndef FME_CITY_JSON_BOX_H
+#define FME_CITY_JSON_BOX_H
+/*=============================================================================
+
+   Name     : fmecityjsonbox.h
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Declaration of FMECityJSONBox
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+#include <limits>
+
+#include "fmecityjsonvertexpool.h"
+
+#include <nlohmann/json.hpp>
+// for convenience
+using json = nlohmann::json;
+
+// -----------------------------------------------------------------------
+// A 2D bounding box.  A new one is empty, and grows as points are added.
+struct FMECityJSONBox
+{
+   double minX = std::numeric_limits<double>::infinity();
+   double minY = std::numeric_limits<double>::infinity();
+   double maxX = -std::numeric_limits<double>::infinity();
+   double maxY = -std::numeric_limits<double>::infinity();
+
+   bool empty() const { return minX > maxX; }
+
+   void expand(double x, double y)
+   {
+      if (x < minX) minX = x;
+      if (x > maxX) maxX = x;
+      if (y < minY) minY = y;
+      if (y > maxY) maxY = y;
+   }
+
+   void expand(const FMECityJSONBox& other)
+   {
+      if (not other.empty())
+      {
+         expand(other.minX, other.minY);
+         expand(other.maxX, other.maxY);
+      }
+   }
+
+   // Touching counts.  An empty box intersects nothing.
+   bool intersects(const FMECityJSONBox& other) const
+   {
+      return minX <= other.maxX and other.minX <= maxX and minY <= other.maxY and
+             other.minY <= maxY;
+   }
+};
+
+// Grow the box by every vertex the "boundaries" of a geometry point to, however
+// deeply they are nested.  No geometry is made, we only look up the coordinates.
+// Indices that aren't in the pool are ignored.
+void addBoundariesToBox(const json& boundaries,
+                        const FMECityJSONVertexPool& vertices,
+                        FMECityJSONBox& box);
+
+#endif
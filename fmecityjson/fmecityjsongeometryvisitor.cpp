@@ -36,6 +36,7 @@
 #include "fmecityjsongeometryvisitor.h"
 #include "fmecityjsonpriv.h"
 #include "fmecityjsonwriter.h"
+#include "fmecityjsontexturecopier.h"
 
 #include <fmetypes.h>
 #include <iaggregate.h>
@@ -82,6 +83,8 @@
 #include <itrianglestrip.h>
 #include <ilibrary.h>
 
+#include <iomanip>
+#include <sstream>
 #include <string>
 
 const std::map< std::string, std::vector< std::string > > FMECityJSONGeometryVisitor::semancticsTypes_ = std::map< std::string, std::vector< std::string > >(
@@ -139,16 +142,21 @@ FMECityJSONGeometryVisitor::FMECityJSONGeometryVisitor(const IFMEGeometryTools*
                                                        IFMESession* session,
                                                        bool remove_duplicates,
                                                        int important_digits,
+                                                       bool quantize_vertices,
                                                        std::map<FME_UInt32, int>& textureRefsToCJIndex,
-                                                       std::map<MaterialInfo, int>& materialInfoToCJIndex)
+                                                       std::map<MaterialInfo, int>& materialInfoToCJIndex,
+                                                       RasterContentKeys& rasterContentKeys)
    :
    fmeGeometryTools_(geomTools),
    fmeSession_(session),
    remove_duplicates_(remove_duplicates),
    important_digits_(important_digits),
+   coordinateMultiplier_(std::pow(10.0, important_digits)),
+   quantize_vertices_(quantize_vertices),
    skipLastPointOnLine_(false),
    textureRefsToCJIndex_(textureRefsToCJIndex),
-   materialInfoToCJIndex_(materialInfoToCJIndex)
+   materialInfoToCJIndex_(materialInfoToCJIndex),
+   rasterContentKeys_(rasterContentKeys)
 {
    logFile_ = session->logFile();
    uCoordDesc_ = session->createString();
@@ -179,13 +187,25 @@ json FMECityJSONGeometryVisitor::getGeomJSON()
 json FMECityJSONGeometryVisitor::getTexCoordsJSON()
 {
    json retVal;
-   // This holds an array of strings, but each string is a (nested) JSON array.
    if (!textureCoords_.empty())
    {
+      // Whole numbers go out as integers, like 0 and 1 always have.
+      std::int64_t unit(0);
+      quantizeCoordinate(1.0, coordinateMultiplier_, unit);
+      auto toJSON = [this, unit](std::int64_t value) -> json {
+         if (value != kQuantizedNaN && unit != 0 && value % unit == 0)
+         {
+            return value / unit;
+         }
+         return dequantizeCoordinate(value, coordinateMultiplier_);
+      };
+
       retVal = json::array();
-      for (auto& oneElement : textureCoords_)
+      json::array_t& uvs = retVal.get_ref<json::array_t&>();
+      uvs.reserve(textureCoords_.size());
+      for (const auto& uv : textureCoords_)
       {
-         retVal.push_back(json::parse(oneElement));
+         uvs.push_back({toJSON(uv[0]), toJSON(uv[1])});
       }
    }
    textureCoords_.clear();
@@ -267,11 +287,25 @@ const VertexPool& FMECityJSONGeometryVisitor::getGeomVertices()
    return vertices_;
 }
 
+const QuantizedVertexPool& FMECityJSONGeometryVisitor::getQuantizedGeomVertices()
+{
+   return quantizedVertices_;
+}
+
 const TexCoordPool& FMECityJSONGeometryVisitor::getTextureCoords()
 {
    return textureCoords_;
 }
 
+void FMECityJSONGeometryVisitor::clearGeomVertices()
+{
+   vertices_.clear();
+   quantizedVertices_.clear();
+   vertexToIndex_.clear();
+   textureCoords_.clear();
+   textureCoordToIndex_.clear();
+}
+
 void FMECityJSONGeometryVisitor::getGeomBounds(std::optional<double>& minx,
                                                std::optional<double>& miny,
                                                std::optional<double>& minz,
@@ -298,6 +332,12 @@ json FMECityJSONGeometryVisitor::getTemplateJSON()
    return result;
 }
 
+void FMECityJSONGeometryVisitor::clearAppearanceCache()
+{
+   appearanceRefToCJIndices_.clear();
+   textureKeyToCJIndex_.clear();
+}
+
 bool FMECityJSONGeometryVisitor::semanticTypeAllowed(std::string trait)
 {
    if (trait.compare(0, 1, "+") == 0) {
@@ -347,69 +387,63 @@ json FMECityJSONGeometryVisitor::replaceSemanticValues(std::vector<json> semanti
    return nullptr;
 }
 
-// Converts a value into a string
-std::string get_key(FME_Real64 val, int precision)
+// A structural hash of a semantic surface, which agrees with json's operator==.
+// That means numbers are hashed by their value, whatever their type (1 == 1.0).
+std::size_t semanticsHash(const json& value)
 {
-   char buf[200];
-   std::stringstream ss;
-   ss << "%." << precision << "f";
-   std::sprintf(buf, ss.str().c_str(), val);
-   std::string r(buf);
-
-   // Pretty it up a bit if it has a decimal place (remove trailing zeros)
-   if (r.find('.') != std::string::npos)
-   {
-      // Remove trailing 0s
-      r = r.substr(0, r.find_last_not_of('0') + 1);
-      // If the decimal point is now the last character, remove that as well
-      if (r.find('.') == r.size() - 1)
+   std::size_t seed = std::size_t(value.type() == json::value_t::number_integer ||
+                                  value.type() == json::value_t::number_unsigned
+                                     ? json::value_t::number_float
+                                     : value.type());
+   auto combine = [&seed](std::size_t h) {
+      seed ^= h + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+   };
+
+   switch (value.type())
+   {
+      case json::value_t::object:
+         for (auto it = value.begin(); it != value.end(); ++it)
+         {
+            combine(std::hash<std::string>()(it.key()));
+            combine(semanticsHash(it.value()));
+         }
+         break;
+      case json::value_t::array:
+         for (const auto& element : value)
+         {
+            combine(semanticsHash(element));
+         }
+         break;
+      case json::value_t::string:
+         combine(std::hash<std::string>()(value.get_ref<const std::string&>()));
+         break;
+      case json::value_t::boolean:
+         combine(std::hash<bool>()(value.get<bool>()));
+         break;
+      case json::value_t::number_integer:
+      case json::value_t::number_unsigned:
+      case json::value_t::number_float:
       {
-         r = r.substr(0, r.size() - 1);
+         double d = value.get<double>();
+         if (d == 0.0) d = 0.0; // -0.0 == 0.0
+         combine(std::hash<double>()(d));
+         break;
       }
+      default:
+         break;
    }
-
-   return r;
-}
-
-// Converts a point into a string
-std::string get_key(const FMECoord3D& vertex, int precision)
-{
-   return (get_key(vertex.x, precision) + ' ' + 
-           get_key(vertex.y, precision) + ' ' +
-           get_key(vertex.z, precision));
-}
-
-std::string get_key(const FMECoord2D& vertex, int precision)
-{
-   // we put commas in this key, as it will be used to make JSON later.
-   return (get_key(vertex.x, precision) + ", " +
-           get_key(vertex.y, precision));
-}
-
-
-void tokenize(const std::string& str, std::vector<std::string>& tokens)
-{
-   std::string::size_type lastPos = str.find_first_not_of(" ", 0);
-   std::string::size_type pos     = str.find_first_of(" ", lastPos);
-   while (std::string::npos != pos || std::string::npos != lastPos)
-   {
-      tokens.push_back(str.substr(lastPos, pos - lastPos));
-      lastPos = str.find_first_not_of(" ", pos);
-      pos     = str.find_first_of(" ", lastPos);
-   }
+   return seed;
 }
 
-void FMECityJSONGeometryVisitor::acceptVertex(const std::string& vertex_string, 
+void FMECityJSONGeometryVisitor::acceptVertex(const FMECityJSONQuantizedIndex<3>::Key& key,
                                               VertexPool& vertices, // out
                                               const bool updateBounds)
 {
-   // Sadly, we need to calculate our bounds from the stringified vertex we
-   // are using.  So back to float!
-   std::vector<std::string> ls;
-   tokenize(vertex_string, ls);
-   double x = std::stod(ls[0]);
-   double y = std::stod(ls[1]);
-   double z = std::stod(ls[2]);
+   // We calculate our bounds from the rounded vertex we are writing, not
+   // the original one.
+   double x = dequantizeCoordinate(key[0], coordinateMultiplier_);
+   double y = dequantizeCoordinate(key[1], coordinateMultiplier_);
+   double z = dequantizeCoordinate(key[2], coordinateMultiplier_);
 
    if (updateBounds)
    {
@@ -424,14 +458,39 @@ void FMECityJSONGeometryVisitor::acceptVertex(const std::string& vertex_string,
       }
    }
 
-   vertices.push_back({x, y, z});
+   // The template vertices are never transformed, so they always stay as doubles.
+   if (quantize_vertices_ && !insideTemplateGeom_)
+   {
+      quantizedVertices_.push_back(key);
+   }
+   else
+   {
+      vertices.push_back({x, y, z});
+   }
+}
+
+FME_Status FMECityJSONGeometryVisitor::quantize(double value, std::int64_t& quantized)
+{
+   if (!quantizeCoordinate(value, coordinateMultiplier_, quantized))
+   {
+      std::ostringstream message;
+      message << kMsgCoordinateTooLarge << std::setprecision(17) << value << " ("
+              << important_digits_ << " digits)";
+      logFile_->logMessageString(message.str().c_str(), FME_ERROR);
+      return FME_FAILURE;
+   }
+   return FME_SUCCESS;
 }
 
 // This will make sure we don't add any vertex twice.
-unsigned long FMECityJSONGeometryVisitor::addVertex(const FMECoord3D& vertex)
+FME_Status FMECityJSONGeometryVisitor::addVertex(const FMECoord3D& vertex, unsigned long& index)
 {
-   // This is the vertex, as a string, which we'll use.
-   std::string vertex_string = get_key(vertex, important_digits_);
+   // This is the vertex, rounded to the digits we keep, which we'll use.
+   FMECityJSONQuantizedIndex<3>::Key key;
+   if (quantize(vertex.x, key[0]) || quantize(vertex.y, key[1]) || quantize(vertex.z, key[2]))
+   {
+      return FME_FAILURE;
+   }
 
    // If we're inside a template geom the bounds should not be updated
    // and the vertices should go into a separate vertex pool
@@ -440,28 +499,28 @@ unsigned long FMECityJSONGeometryVisitor::addVertex(const FMECoord3D& vertex)
    const bool updateBounds = !insideTemplateGeom_;
 
    // This will be the index in the vertex pool if it is new
-   unsigned long index(vertices.size());
+   index = (quantize_vertices_ && !insideTemplateGeom_) ? quantizedVertices_.size() : vertices.size();
 
    // A little more bookkeeping if we want to optimize the vertex pool
    // and not have duplicates.
    if (remove_duplicates_)
    {
       // Have we encountered this vertex before?
-      auto [entry, vertexAdded] = vertexToIndex.try_emplace(vertex_string, index);
+      auto [entry, vertexAdded] = vertexToIndex.tryEmplace(key, index);
       if (!vertexAdded) // We already have this in our vertex pool
       {
-         index = entry->second;
+         index = entry;
       }
       else // We haven't seen this before, so insert it into the pool.
       {
-         acceptVertex(vertex_string, vertices, updateBounds);
+         acceptVertex(key, vertices, updateBounds);
 
          // index is already set correctly.
       }
    }
    else
    {
-      acceptVertex(vertex_string, vertices, updateBounds);
+      acceptVertex(key, vertices, updateBounds);
 
       // index is already set correctly.
    }
@@ -469,26 +528,30 @@ unsigned long FMECityJSONGeometryVisitor::addVertex(const FMECoord3D& vertex)
 }
 
 // This will make sure we don't add any texture coord twice.
-unsigned long FMECityJSONGeometryVisitor::addTextureCoord(const FMECoord2D& texcoord)
+FME_Status FMECityJSONGeometryVisitor::addTextureCoord(const FMECoord2D& texcoord, unsigned long& index)
 {
-   // This is the vertex, as a string, which we'll use.
-   std::string texcoord_key = get_key(texcoord, important_digits_);
+   // This is the texture coordinate, rounded to the digits we keep, which we'll use.
+   FMECityJSONQuantizedIndex<2>::Key texcoord_key;
+   if (quantize(texcoord.x, texcoord_key[0]) || quantize(texcoord.y, texcoord_key[1]))
+   {
+      return FME_FAILURE;
+   }
 
    // This will be the index in the vertex pool if it is new
-   unsigned long index(textureCoords_.size());
+   index = textureCoords_.size();
 
    // A little more bookkeeping if we want to optimize the texture coordinate pool
    // and not have duplicates.
 
    // Have we encountered this texture coordinate before?
-   auto [entry, texCoordAdded] = textureCoordToIndex_.try_emplace(texcoord_key, index);
+   auto [entry, texCoordAdded] = textureCoordToIndex_.tryEmplace(texcoord_key, index);
    if (!texCoordAdded) // We already have this in our texture coordinate pool
    {
-      index = entry->second;
+      index = entry;
    }
    else // We haven't seen this before, so insert it into the pool.
    {
-      textureCoords_.push_back('[' + texcoord_key + ']');
+      textureCoords_.push_back(texcoord_key);
 
       // index is already set correctly.
    }
@@ -496,6 +559,41 @@ unsigned long FMECityJSONGeometryVisitor::addTextureCoord(const FMECoord2D& texc
    return index;
 }
 
+//=====================================================================
+std::string FMECityJSONGeometryVisitor::getTextureContentKey(FME_UInt32 texRef)
+{
+   IFMETexture* tex = fmeSession_->getLibrary()->getTextureCopy(texRef);
+   if (!tex)
+   {
+      return "texture " + std::to_string(texRef);
+   }
+
+   std::string key;
+   FME_UInt32 rasterRef(0);
+   if (FME_TRUE == tex->getRasterReference(rasterRef))
+   {
+      // The pixels identify the image.  If we can't read them, all we have
+      // is the raster reference.
+      const std::string& contentKey = lookupRasterContentKey(rasterRef, *fmeSession_, rasterContentKeys_);
+      key = contentKey.empty() ? "raster " + std::to_string(rasterRef) : "image " + contentKey;
+   }
+
+   FME_TextureWrap wrapStyle;
+   tex->getTextureWrap(wrapStyle);
+   key += " wrap " + std::to_string(int(wrapStyle));
+
+   FME_Real64 r(0.0), g(0.0), b(0.0);
+   if (FME_TRUE == tex->getBorderColor(r, g, b))
+   {
+      std::ostringstream color;
+      color << std::setprecision(17) << " border " << r << ' ' << g << ' ' << b;
+      key += color.str();
+   }
+
+   fmeGeometryTools_->destroyTexture(tex); tex = nullptr;
+   return key;
+}
+
 //=====================================================================
 int FMECityJSONGeometryVisitor::getMaterialRefFromAppearance(const IFMEAppearance* app)
 {
@@ -710,6 +808,7 @@ void FMECityJSONGeometryVisitor::completedGeometry(bool topLevel,
 
       outputgeom_.clear();
       surfaces_.clear();
+      surfaceIndex_.clear();
       semanticValues_.clear();
       workingBoundary_.clear();
       workingTexCoords_.clear();
@@ -812,7 +911,10 @@ FME_Status FMECityJSONGeometryVisitor::visitAggregate(const IFMEAggregate& aggre
           matrix[2][0], matrix[2][1], matrix[2][2], matrix[2][3],
           0.0, 0.0, 0.0, 1.0};
 
-      completedGeometry(topLevel, { addVertex(origin) }, {}, {});
+      unsigned long index(0);
+      const FME_Status badLuck = addVertex(origin, index);
+      if (badLuck) return badLuck;
+      completedGeometry(topLevel, { index }, {}, {});
    }
    else
    {
@@ -840,7 +942,9 @@ FME_Status FMECityJSONGeometryVisitor::visitPoint(const IFMEPoint& point)
 
    bool topLevel = claimTopLevel("MultiPoint");
 
-   unsigned long index = addVertex({point.getX(), point.getY(), point.getZ()});
+   unsigned long index(0);
+   const FME_Status badLuck = addVertex({point.getX(), point.getY(), point.getZ()}, index);
+   if (badLuck) return badLuck;
 
    // We have to make an array of only one!
    auto jsonArray = json::array();
@@ -934,7 +1038,9 @@ FME_Status FMECityJSONGeometryVisitor::visitLine(const IFMELine& line)
    {
       FMECoord3D point;
       line.getPointAt3D(i, point);
-      unsigned long index = addVertex(point);
+      unsigned long index(0);
+      const FME_Status badLuck = addVertex(point, index);
+      if (badLuck) return badLuck;
       jsonArray.push_back(index);
    }
 
@@ -953,15 +1059,17 @@ FME_Status FMECityJSONGeometryVisitor::visitLine(const IFMELine& line)
    FME_Real64* uCoords = new FME_Real64[line.numPoints()];
    FME_Real64* vCoords = new FME_Real64[line.numPoints()];
 
+   FME_Status badLuck(FME_SUCCESS);
    if ((FME_SUCCESS == line.getNamedMeasureValues(*uCoordDesc_, uCoords)) &&
        (FME_SUCCESS == line.getNamedMeasureValues(*vCoordDesc_, vCoords)))
    {
       // The index to the texture is first.
       jsonTCArray.push_back(nextTextRef_);
-      for (FME_UInt32 i = 0; i < line.numPoints() - skip; i++)
+      for (FME_UInt32 i = 0; !badLuck && i < line.numPoints() - skip; i++)
       {
          FMECoord2D uvCoord(uCoords[i], vCoords[i]);
-         unsigned long index = addTextureCoord(uvCoord);
+         unsigned long index(0);
+         badLuck = addTextureCoord(uvCoord, index);
          jsonTCArray.push_back(index);
       }
    }
@@ -972,6 +1080,7 @@ FME_Status FMECityJSONGeometryVisitor::visitLine(const IFMELine& line)
 
    delete [] uCoords; uCoords = nullptr;
    delete [] vCoords; vCoords = nullptr;
+   if (badLuck) return badLuck;
 
    completedGeometry(topLevel, jsonArray, jsonTCArray, {});
 
@@ -1261,33 +1370,46 @@ FME_Status FMECityJSONGeometryVisitor::visitFace(const IFMEFace& face)
          frontAppRef = parentAppearanceRef_;
       }
 
-      // Is this appearance a texture or a material?
-      IFMEAppearance* app = fmeSession_->getLibrary()->getAppearanceCopy(frontAppRef);
-      if (app) // if the appRef was "0" or "-1" we don't expect a reference
+      // Have we seen this appearance before?
+      auto cached = appearanceRefToCJIndices_.find(frontAppRef);
+      if (cached != appearanceRefToCJIndices_.end())
       {
-         FME_UInt32 texRef(0);
-         if (FME_TRUE == app->getTextureReference(texRef))
+         std::tie(cityJSONTexIndex, cityJSONMaterialIndex) = cached->second;
+      }
+      else
+      {
+         // Is this appearance a texture or a material?
+         IFMEAppearance* app = fmeSession_->getLibrary()->getAppearanceCopy(frontAppRef);
+         if (app) // if the appRef was "0" or "-1" we don't expect a reference
          {
-            // We've got a texture.
-            // One we've never seen before?
-            auto refIndex = textureRefsToCJIndex_.find(texRef);
-            if (refIndex == textureRefsToCJIndex_.end())
-            {
-               // Storing an increasing number means we'll get the right
-               // index later.
-               cityJSONTexIndex = textureRefsToCJIndex_.size();
-               textureRefsToCJIndex_[texRef] = cityJSONTexIndex;
-            }
-            else
+            FME_UInt32 texRef(0);
+            if (FME_TRUE == app->getTextureReference(texRef))
             {
-               cityJSONTexIndex = refIndex->second;
+               // We've got a texture.
+               // One we've never seen before?
+               auto refIndex = textureRefsToCJIndex_.find(texRef);
+               if (refIndex == textureRefsToCJIndex_.end())
+               {
+                  // Storing an increasing number means we'll get the right
+                  // index later.  A texture with the same content as one we
+                  // already have just shares its index.
+                  auto inserted = textureKeyToCJIndex_.emplace(getTextureContentKey(texRef),
+                                                               int(textureKeyToCJIndex_.size()));
+                  cityJSONTexIndex = inserted.first->second;
+                  textureRefsToCJIndex_[texRef] = cityJSONTexIndex;
+               }
+               else
+               {
+                  cityJSONTexIndex = refIndex->second;
+               }
             }
-         }
 
-         // Do we have enough non-default info here to mean we have a "material'?
-         cityJSONMaterialIndex = getMaterialRefFromAppearance(app);
+            // Do we have enough non-default info here to mean we have a "material'?
+            cityJSONMaterialIndex = getMaterialRefFromAppearance(app);
 
-         fmeGeometryTools_->destroyAppearance(app); app = nullptr;
+            fmeGeometryTools_->destroyAppearance(app); app = nullptr;
+         }
+         appearanceRefToCJIndices_[frontAppRef] = {cityJSONTexIndex, cityJSONMaterialIndex};
       }
    }
 
@@ -1388,11 +1510,14 @@ FME_Status FMECityJSONGeometryVisitor::visitFace(const IFMEFace& face)
          //-- De-duplicate surface semantics and keep correct number of semantic to store in values
          //-- Take into account not only semantics type since type can be same with different attribute values
          //-- Can use == to compare two json objects, comparison works on nested values of objects
-         //-- check if semantic surface description exists
+         //-- check if semantic surface description exists, only looking at the ones with the same hash
+         const std::size_t surfaceHash = semanticsHash(surfaceSemantics);
          int surfaceIdx = -1;
-         for (int i = 0; i < surfaces_.size(); i++) {
-            if (surfaces_[i] == surfaceSemantics) {
-               surfaceIdx = i;
+         auto [first, last] = surfaceIndex_.equal_range(surfaceHash);
+         for (auto it = first; it != last; ++it) {
+            if (surfaces_[it->second] == surfaceSemantics) {
+               surfaceIdx = it->second;
+               break;
             }
          }
          if (surfaceIdx != -1) { // store value for existing semantic surface
@@ -1400,6 +1525,7 @@ FME_Status FMECityJSONGeometryVisitor::visitFace(const IFMEFace& face)
          }
          else { // store new semantic surface and its value 
             surfaces_.push_back(surfaceSemantics);
+            surfaceIndex_.emplace(surfaceHash, int(surfaces_.size() - 1));
             semanticValues_.push_back(surfaces_.size() - 1);
          }
          fmeSession_->destroyStringArray(traitNames);
@@ -38,15 +38,21 @@
 #include <igeometrytools.h>
 #include <igeometryvisitor.h>
 #include "fmecityjsonpriv.h"
+#include "fmecityjsonquantizedindex.h"
+#include "fmecityjsontexturecopier.h"
 #include <isolid.h>
 
 #include <vector>
 #include <optional>
+#include <unordered_map>
 
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
 using VertexPool = std::vector<std::tuple<double, double, double>>;
-using TexCoordPool = std::vector<std::string>;
+// Vertices as integer multiples of 10^-important_digits (see quantizeCoordinate())
+using QuantizedVertexPool = std::vector<FMECityJSONQuantizedIndex<3>::Key>;
+// Texture coordinates, quantized the same way as the vertices
+using TexCoordPool = std::vector<FMECityJSONQuantizedIndex<2>::Key>;
 
 // I use a tuple here, so it can be easily used as a key to a std::map, for uniqueness.
 using MaterialInfo = std::tuple<
@@ -77,8 +83,10 @@ public:
                               IFMESession* session,
                               bool remove_duplicates,
                               int important_digits,
+                              bool quantize_vertices,
                               std::map<FME_UInt32, int>& textureRefsToCJIndex,
-                              std::map<MaterialInfo, int>& materialInfoToCJIndex);
+                              std::map<MaterialInfo, int>& materialInfoToCJIndex,
+                              RasterContentKeys& rasterContentKeys);
 
    //---------------------------------------------------------------------
    // Destructor.
@@ -245,9 +253,16 @@ public:
 
    //----------------------------------------------------------------------
    // get the array of vertices for the geometry
+   // (when quantizing vertices, they are in getQuantizedGeomVertices() instead)
    const VertexPool& getGeomVertices();
+   const QuantizedVertexPool& getQuantizedGeomVertices();
    const TexCoordPool& getTextureCoords();
 
+   //----------------------------------------------------------------------
+   // forget the vertices and texture coordinates collected so far, so the
+   // next feature starts with its own pools (the bounds are kept)
+   void clearGeomVertices();
+
    //----------------------------------------------------------------------
    // get bounds of vertices for the geometry
    void getGeomBounds(std::optional<double>& minx,
@@ -260,6 +275,11 @@ public:
    //----------------------------------------------------------------------
    json getTemplateJSON();
 
+   //----------------------------------------------------------------------
+   // forget what each appearance reference resolved to; this must be called
+   // whenever the texture or material indices are cleared
+   void clearAppearanceCache();
+
    //----------------------------------------------------------------------
    // check if the surface semantics type is allowed for this CityObjectType
    bool semanticTypeAllowed(std::string trait);
@@ -293,14 +313,23 @@ private:
 
    //---------------------------------------------------------------------
    // The vertex is added to the vertex pool.  It will not add duplicates.
-   // The index of the vertex in the pool is returned.
-   unsigned long addVertex(const FMECoord3D& vertex);
-   void acceptVertex(const std::string& vertex_string, VertexPool& output, bool updateBounds);
-   unsigned long addTextureCoord(const FMECoord2D& texcoord);
+   // The index of the vertex in the pool is returned.  It fails if a coordinate
+   // doesn't fit once it is rounded to the important digits.
+   FME_Status addVertex(const FMECoord3D& vertex, unsigned long& index);
+   void acceptVertex(const FMECityJSONQuantizedIndex<3>::Key& key, VertexPool& output, bool updateBounds);
+   FME_Status addTextureCoord(const FMECoord2D& texcoord, unsigned long& index);
+
+   // Round a coordinate to the important digits, logging an error if it doesn't fit.
+   FME_Status quantize(double value, std::int64_t& quantized);
 
    //---------------------------------------------------------------------
    int getMaterialRefFromAppearance(const IFMEAppearance* app);
 
+   //---------------------------------------------------------------------
+   // Textures which would come out exactly the same in the "textures" array
+   // get the same key, so they can share one entry.
+   std::string getTextureContentKey(FME_UInt32 texRef);
+
    //---------------------------------------------------------------------
    // This allows easy access to turn on/off debug logging throughout this class.
    void logDebugMessage(const std::string& message)
@@ -445,6 +474,9 @@ private:
    json workingMaterialRefs_;
    bool remove_duplicates_; 
    int important_digits_; 
+   double coordinateMultiplier_; // 10^important_digits_
+   // Keep the vertices as integers (for a "transform"), not as doubles.
+   bool quantize_vertices_;
 
    // Let's track things so we don't log so much.
    std::map<std::string, int> limitLogging_;
@@ -454,6 +486,7 @@ private:
 
    //-- semantics of surfaces
    std::vector< json > surfaces_; //-- all the surfaces (which are json object; same ones are merged)
+   std::unordered_multimap< std::size_t, int > surfaceIndex_; //-- hash of a surface -> index in surfaces_
    std::vector< json > semanticValues_; //-- values for MultiSurfaces and CompositeSurfaces
    std::vector< json > solidSemanticValues_;
    std::vector< json > multiSolidSemanticValues_;
@@ -466,13 +499,25 @@ private:
    // Keeping track of materials in appearances
    std::map<MaterialInfo, int>& materialInfoToCJIndex_;
 
+   // The same few appearances are shared by lots of faces, so we remember what
+   // each FME appearance reference gave us: (texture index, material index).
+   std::unordered_map<FME_UInt32, std::pair<int, int>> appearanceRefToCJIndices_;
+
+   // Different texture references can still be the same image, with the same
+   // settings.  This maps the content of each texture to its index.
+   std::map<std::string, int> textureKeyToCJIndex_;
+
+   // What is in each raster, shared with the writer.
+   RasterContentKeys& rasterContentKeys_;
+
    // Maps a vertex to a specific index in the vertex pool.
-   std::unordered_map<std::string, unsigned long> vertexToIndex_;
+   FMECityJSONQuantizedIndex<3> vertexToIndex_;
    VertexPool vertices_;
+   QuantizedVertexPool quantizedVertices_;
    std::optional<double> minx_, miny_, minz_, maxx_, maxy_, maxz_;
 
    // Maps a texture coordinate to a specific index in the textCoord pool
-   std::unordered_map<std::string, unsigned long> textureCoordToIndex_;
+   FMECityJSONQuantizedIndex<2> textureCoordToIndex_;
    TexCoordPool textureCoords_;
    // If we need texture coordinates from a parent object, set this
    // up high so the line down below knows which ref to use.
@@ -492,7 +537,7 @@ private:
    // respectively.
    bool insideTemplateGeom_ = false;
    json templateGeoms_ = json::array();
-   std::unordered_map<std::string, unsigned long> templateVertexToIndex_;
+   FMECityJSONQuantizedIndex<3> templateVertexToIndex_;
    VertexPool templateVertices_;
    std::unordered_map<FME_UInt32, std::size_t> gdReferenceToTemplateIndex_;
 };
@@ -0,0 +1,232 @@
+/*=============================================================================
+
+   Name     : fmecityjsonmappedfile.cpp
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Implementation of FMECityJSONMappedFile
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+// Include Files
+#include "fmecityjsonmappedfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// What we point at for an empty file, since we can't map zero bytes.
+static const char kEmptyFile[] = "";
+
+//===========================================================================
+// Constructor
+FMECityJSONMappedFile::FMECityJSONMappedFile()
+   : data_(nullptr),
+     size_(0)
+#ifdef _WIN32
+     ,
+     fileHandle_(INVALID_HANDLE_VALUE),
+     mappingHandle_(nullptr)
+#endif
+{
+}
+
+//===========================================================================
+// Destructor
+FMECityJSONMappedFile::~FMECityJSONMappedFile()
+{
+   close();
+}
+
+#ifdef _WIN32
+
+//===========================================================================
+bool FMECityJSONMappedFile::open(const std::string& fileName)
+{
+   close();
+
+   fileHandle_ = CreateFileA(fileName.c_str(),
+                             GENERIC_READ,
+                             FILE_SHARE_READ,
+                             nullptr,
+                             OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                             nullptr);
+   if (fileHandle_ == INVALID_HANDLE_VALUE)
+   {
+      return false;
+   }
+
+   LARGE_INTEGER fileSize;
+   if (not GetFileSizeEx(fileHandle_, &fileSize))
+   {
+      close();
+      return false;
+   }
+   size_ = static_cast<std::size_t>(fileSize.QuadPart);
+
+   if (size_ == 0)
+   {
+      data_ = kEmptyFile;
+      return true;
+   }
+
+   mappingHandle_ = CreateFileMappingA(fileHandle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+   if (mappingHandle_ == nullptr)
+   {
+      close();
+      return false;
+   }
+
+   data_ = static_cast<const char*>(MapViewOfFile(mappingHandle_, FILE_MAP_READ, 0, 0, 0));
+   if (data_ == nullptr)
+   {
+      close();
+      return false;
+   }
+
+   return true;
+}
+
+//===========================================================================
+void FMECityJSONMappedFile::close()
+{
+   if (data_ != nullptr and data_ != kEmptyFile)
+   {
+      UnmapViewOfFile(data_);
+   }
+   data_ = nullptr;
+   size_ = 0;
+
+   if (mappingHandle_ != nullptr)
+   {
+      CloseHandle(mappingHandle_);
+      mappingHandle_ = nullptr;
+   }
+   if (fileHandle_ != INVALID_HANDLE_VALUE)
+   {
+      CloseHandle(fileHandle_);
+      fileHandle_ = INVALID_HANDLE_VALUE;
+   }
+}
+
+//===========================================================================
+void FMECityJSONMappedFile::adviseSequential() const
+{
+   // We already asked for FILE_FLAG_SEQUENTIAL_SCAN when opening the file.
+}
+
+//===========================================================================
+bool FMECityJSONMappedFile::isPaddedBy(std::size_t padding) const
+{
+   if (data_ == nullptr or data_ == kEmptyFile) return false;
+
+   SYSTEM_INFO systemInfo;
+   GetSystemInfo(&systemInfo);
+   const std::size_t pageSize = systemInfo.dwPageSize;
+   const std::size_t used     = size_ % pageSize;
+   return used != 0 and pageSize - used >= padding;
+}
+
+#else
+
+//===========================================================================
+bool FMECityJSONMappedFile::open(const std::string& fileName)
+{
+   close();
+
+   int fd = ::open(fileName.c_str(), O_RDONLY);
+   if (fd < 0)
+   {
+      return false;
+   }
+
+   struct stat fileInfo;
+   if (fstat(fd, &fileInfo) != 0 or not S_ISREG(fileInfo.st_mode))
+   {
+      ::close(fd);
+      return false;
+   }
+   size_ = static_cast<std::size_t>(fileInfo.st_size);
+
+   if (size_ == 0)
+   {
+      ::close(fd);
+      data_ = kEmptyFile;
+      return true;
+   }
+
+   void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+   // The mapping keeps its own reference to the file.
+   ::close(fd);
+   if (mapping == MAP_FAILED)
+   {
+      size_ = 0;
+      return false;
+   }
+
+   data_ = static_cast<const char*>(mapping);
+   return true;
+}
+
+//===========================================================================
+void FMECityJSONMappedFile::close()
+{
+   if (data_ != nullptr and data_ != kEmptyFile)
+   {
+      munmap(const_cast<char*>(data_), size_);
+   }
+   data_ = nullptr;
+   size_ = 0;
+}
+
+//===========================================================================
+void FMECityJSONMappedFile::adviseSequential() const
+{
+   if (data_ != nullptr and data_ != kEmptyFile)
+   {
+      madvise(const_cast<char*>(data_), size_, MADV_SEQUENTIAL);
+   }
+}
+
+//===========================================================================
+bool FMECityJSONMappedFile::isPaddedBy(std::size_t padding) const
+{
+   if (data_ == nullptr or data_ == kEmptyFile) return false;
+
+   const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+   const std::size_t used     = size_ % pageSize;
+   return used != 0 and pageSize - used >= padding;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef FME_CITY_JSON_MAPPED_FILE_H
+#define FME_CITY_JSON_MAPPED_FILE_H
+/*=============================================================================
+
+   Name     : fmecityjsonmappedfile.h
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Declaration of FMECityJSONMappedFile
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// -----------------------------------------------------------------------
+// A read-only memory mapping of a whole input file.  Parsing straight from
+// the mapping saves the copy into a stream buffer, and lets us hand out
+// string_views into the file instead of copying strings around.
+class FMECityJSONMappedFile
+{
+public:
+   FMECityJSONMappedFile();
+   ~FMECityJSONMappedFile();
+
+   // Map the whole file.  Returns false if the file can't be opened or mapped.
+   bool open(const std::string& fileName);
+
+   // Unmap the file.  Any pointers or string_views into it are invalid after this.
+   void close();
+
+   bool isOpen() const { return data_ != nullptr; }
+
+   const char* begin() const { return data_; }
+   const char* end() const { return data_ + size_; }
+   std::size_t size() const { return size_; }
+
+   // A view of part of the file.
+   std::string_view view(std::size_t offset, std::size_t length) const
+   {
+      return std::string_view(data_ + offset, length);
+   }
+
+   // Tell the OS we are about to go through the file from start to end.
+   void adviseSequential() const;
+
+   // Is there room in the last page of the mapping for this many (zero) bytes
+   // after the end of the file?  Some parsers like to read a little past the end.
+   bool isPaddedBy(std::size_t padding) const;
+
+private:
+   // Copy constructor
+   FMECityJSONMappedFile(const FMECityJSONMappedFile&);
+
+   // Assignment operator
+   FMECityJSONMappedFile& operator=(const FMECityJSONMappedFile&);
+
+   const char* data_;
+   std::size_t size_;
+
+#ifdef _WIN32
+   void* fileHandle_;
+   void* mappingHandle_;
+#endif
+};
+
+#endif
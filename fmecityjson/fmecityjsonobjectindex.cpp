@@ -0,0 +1,399 @@
+/*=============================================================================
+
+   Name     : fmecityjsonobjectindex.cpp
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Implementation of FMECityJSONObjectIndex
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+// Include Files
+#include "fmecityjsonobjectindex.h"
+
+#include <algorithm>
+
+namespace
+{
+   // Entry flags, as saved in toJSON().
+   const unsigned kAlwaysRead        = 1;
+   const unsigned kLodMaskIncomplete = 2;
+
+   //===========================================================================
+   void hashBytes(std::uint64_t& hash, const char* data, std::size_t size)
+   {
+      for (std::size_t i = 0; i < size; ++i)
+      {
+         hash ^= static_cast<unsigned char>(data[i]);
+         hash *= 1099511628211ULL;
+      }
+   }
+}
+
+//===========================================================================
+std::uint64_t hashFileSample(const char* data, std::size_t size)
+{
+   const std::size_t kBlockSize = 1 << 16;
+   const std::size_t kNumBlocks = 64;
+
+   // FNV-1a
+   std::uint64_t hash = 14695981039346656037ULL;
+   if (size <= kBlockSize * (kNumBlocks + 2))
+   {
+      hashBytes(hash, data, size);
+      return hash;
+   }
+
+   hashBytes(hash, data, kBlockSize);
+   const std::size_t step = (size - kBlockSize) / (kNumBlocks + 1);
+   for (std::size_t i = 1; i <= kNumBlocks; ++i)
+   {
+      hashBytes(hash, data + i * step, kBlockSize);
+   }
+   hashBytes(hash, data + size - kBlockSize, kBlockSize);
+   return hash;
+}
+
+//===========================================================================
+std::uint64_t hashFileContents(const char* data, std::size_t size)
+{
+   std::uint64_t hash = 14695981039346656037ULL;
+   hashBytes(hash, data, size);
+   return hash;
+}
+
+//===========================================================================
+void FMECityJSONObjectIndex::clear()
+{
+   *this = FMECityJSONObjectIndex();
+}
+
+//===========================================================================
+void FMECityJSONObjectIndex::setRelations(std::vector<std::pair<std::size_t, std::size_t>> parentChild)
+{
+   parentChild.erase(std::remove_if(parentChild.begin(),
+                                    parentChild.end(),
+                                    [this](const std::pair<std::size_t, std::size_t>& r) {
+                                       return r.first >= entries_.size() or
+                                              r.second >= entries_.size() or r.first == r.second;
+                                    }),
+                     parentChild.end());
+   std::sort(parentChild.begin(), parentChild.end());
+   parentChild.erase(std::unique(parentChild.begin(), parentChild.end()), parentChild.end());
+
+   // Sorted by the parent, so this is the list of children.
+   children_.start.assign(entries_.size() + 1, 0);
+   children_.values.clear();
+   children_.values.reserve(parentChild.size());
+   for (const auto& [parent, child] : parentChild)
+   {
+      ++children_.start[parent + 1];
+      children_.values.push_back(child);
+   }
+
+   // And flipped around, the list of parents.
+   for (auto& r : parentChild)
+   {
+      std::swap(r.first, r.second);
+   }
+   std::sort(parentChild.begin(), parentChild.end());
+   parents_.start.assign(entries_.size() + 1, 0);
+   parents_.values.clear();
+   parents_.values.reserve(parentChild.size());
+   for (const auto& [child, parent] : parentChild)
+   {
+      ++parents_.start[child + 1];
+      parents_.values.push_back(parent);
+   }
+
+   for (std::size_t i = 1; i <= entries_.size(); ++i)
+   {
+      children_.start[i] += children_.start[i - 1];
+      parents_.start[i] += parents_.start[i - 1];
+   }
+}
+
+//===========================================================================
+FMECityJSONObjectIndex::Range FMECityJSONObjectIndex::Lists::range(std::size_t i) const
+{
+   if (i + 1 >= start.size())
+   {
+      return {nullptr, nullptr};
+   }
+   return {values.data() + start[i], values.data() + start[i + 1]};
+}
+
+//===========================================================================
+std::int32_t FMECityJSONObjectIndex::lodId(const std::string& lod)
+{
+   auto inserted = lodIds_.emplace(lod, std::int32_t(lodNames_.size()));
+   if (inserted.second)
+   {
+      lodNames_.push_back(lod);
+   }
+   return inserted.first->second;
+}
+
+//===========================================================================
+std::int32_t FMECityJSONObjectIndex::findLod(const std::string& lod) const
+{
+   auto found = lodIds_.find(lod);
+   return (found == lodIds_.end()) ? -1 : found->second;
+}
+
+//===========================================================================
+std::int32_t FMECityJSONObjectIndex::typeId(const std::string& type)
+{
+   auto inserted = typeIds_.emplace(type, std::int32_t(typeNames_.size()));
+   if (inserted.second)
+   {
+      typeNames_.push_back(type);
+   }
+   return inserted.first->second;
+}
+
+//===========================================================================
+std::int32_t FMECityJSONObjectIndex::findType(const std::string& type) const
+{
+   auto found = typeIds_.find(type);
+   return (found == typeIds_.end()) ? -1 : found->second;
+}
+
+//===========================================================================
+FMECityJSONObjectIndex::FeatureType& FMECityJSONObjectIndex::featureType(const std::string& name)
+{
+   return featureTypes_[name];
+}
+
+//===========================================================================
+void FMECityJSONObjectIndex::FeatureType::setAttributeType(const std::string& name,
+                                                           const std::string& type)
+{
+   auto inserted = attributeIndex_.emplace(name, attributes.size());
+   if (inserted.second)
+   {
+      attributes.emplace_back(name, type);
+   }
+   else
+   {
+      attributes[inserted.first->second].second = type;
+   }
+}
+
+//===========================================================================
+void FMECityJSONObjectIndex::addInvalidAttribute(const std::string& name,
+                                                 const std::string& valueType)
+{
+   const std::pair<std::string, std::string> invalid(name, valueType);
+   if (std::find(invalidAttributes_.begin(), invalidAttributes_.end(), invalid) ==
+       invalidAttributes_.end())
+   {
+      invalidAttributes_.push_back(invalid);
+   }
+}
+
+//===========================================================================
+void FMECityJSONObjectIndex::addUnknownGeometryType(const std::string& type)
+{
+   if (std::find(unknownGeometryTypes_.begin(), unknownGeometryTypes_.end(), type) ==
+       unknownGeometryTypes_.end())
+   {
+      unknownGeometryTypes_.push_back(type);
+   }
+}
+
+//===========================================================================
+json FMECityJSONObjectIndex::toJSON() const
+{
+   json result;
+   result["lodNames"]  = lodNames_;
+   result["typeNames"] = typeNames_;
+
+   // Four numbers per CityObject, all in one flat array.
+   json entries = json::array();
+   entries.get_ref<json::array_t&>().reserve(entries_.size() * 4);
+   for (const Entry& entry : entries_)
+   {
+      entries.push_back(entry.lodMask);
+      entries.push_back(entry.highestLod);
+      entries.push_back((entry.alwaysRead ? kAlwaysRead : 0) |
+                        (entry.lodMaskIncomplete ? kLodMaskIncomplete : 0));
+      entries.push_back(entry.typeId);
+   }
+   result["entries"] = std::move(entries);
+
+   // Four numbers per CityObject again.  An empty box has its min above its max.
+   if (hasBoxes() and not entries_.empty())
+   {
+      json boxes = json::array();
+      boxes.get_ref<json::array_t&>().reserve(boxes_.size() * 4);
+      for (const FMECityJSONBox& box : boxes_)
+      {
+         if (box.empty())
+         {
+            boxes.insert(boxes.end(), {1.0, 1.0, 0.0, 0.0});
+         }
+         else
+         {
+            boxes.insert(boxes.end(), {box.minX, box.minY, box.maxX, box.maxY});
+         }
+      }
+      result["boxes"] = std::move(boxes);
+
+      // Two numbers, the parent and the child, for each relation.
+      json relations = json::array();
+      for (std::size_t parent = 0; parent < entries_.size(); ++parent)
+      {
+         for (auto [child, end] = children(parent); child != end; ++child)
+         {
+            relations.push_back(parent);
+            relations.push_back(*child);
+         }
+      }
+      result["relations"] = std::move(relations);
+   }
+
+   json featureTypes = json::object();
+   for (const auto& [name, featureType] : featureTypes_)
+   {
+      json geometries = json::array();
+      for (const auto& [i, geometryType] : featureType.geometries)
+      {
+         geometries.push_back({i, geometryType});
+      }
+      featureTypes[name] = {{"attributes", featureType.attributes},
+                            {"geometries", geometries},
+                            {"emptyGeometries", featureType.emptyGeometries}};
+   }
+   result["featureTypes"] = std::move(featureTypes);
+
+   result["invalidAttributes"]    = invalidAttributes_;
+   result["unknownGeometryTypes"] = unknownGeometryTypes_;
+   return result;
+}
+
+//===========================================================================
+bool FMECityJSONObjectIndex::fromJSON(const json& value)
+{
+   clear();
+   try
+   {
+      for (const json& lod : value.at("lodNames"))
+      {
+         lodId(lod.get<std::string>());
+      }
+
+      for (const json& type : value.at("typeNames"))
+      {
+         typeId(type.get<std::string>());
+      }
+
+      const json& entries = value.at("entries");
+      if (entries.size() % 4 != 0)
+      {
+         clear();
+         return false;
+      }
+      entries_.reserve(entries.size() / 4);
+      for (std::size_t i = 0; i < entries.size(); i += 4)
+      {
+         Entry entry;
+         entry.lodMask           = entries[i].get<std::uint64_t>();
+         entry.highestLod        = entries[i + 1].get<std::int32_t>();
+         const unsigned flags    = entries[i + 2].get<unsigned>();
+         entry.alwaysRead        = (flags & kAlwaysRead) != 0;
+         entry.lodMaskIncomplete = (flags & kLodMaskIncomplete) != 0;
+         entry.typeId            = entries[i + 3].get<std::int32_t>();
+         if (entry.highestLod >= std::int32_t(lodNames_.size()) or
+             entry.typeId >= std::int32_t(typeNames_.size()))
+         {
+            clear();
+            return false;
+         }
+         entries_.push_back(entry);
+      }
+
+      auto boxes = value.find("boxes");
+      if (boxes != value.end())
+      {
+         if (boxes->size() != entries_.size() * 4)
+         {
+            clear();
+            return false;
+         }
+         boxes_.resize(entries_.size());
+         for (std::size_t i = 0; i < entries_.size(); ++i)
+         {
+            const double minX = (*boxes)[4 * i].get<double>();
+            const double minY = (*boxes)[4 * i + 1].get<double>();
+            const double maxX = (*boxes)[4 * i + 2].get<double>();
+            const double maxY = (*boxes)[4 * i + 3].get<double>();
+            if (minX <= maxX and minY <= maxY)
+            {
+               boxes_[i].expand(minX, minY);
+               boxes_[i].expand(maxX, maxY);
+            }
+         }
+
+         const json& relations = value.at("relations");
+         std::vector<std::pair<std::size_t, std::size_t>> parentChild;
+         parentChild.reserve(relations.size() / 2);
+         for (std::size_t i = 0; i + 1 < relations.size(); i += 2)
+         {
+            parentChild.emplace_back(relations[i].get<std::size_t>(),
+                                     relations[i + 1].get<std::size_t>());
+         }
+         setRelations(std::move(parentChild));
+      }
+
+      for (const auto& [name, saved] : value.at("featureTypes").items())
+      {
+         FeatureType& featureType = featureTypes_[name];
+         for (const auto& attribute : saved.at("attributes"))
+         {
+            featureType.setAttributeType(attribute.at(0).get<std::string>(),
+                                         attribute.at(1).get<std::string>());
+         }
+         for (const auto& geometry : saved.at("geometries"))
+         {
+            featureType.geometries[geometry.at(0).get<int>()] = geometry.at(1).get<std::string>();
+         }
+         featureType.emptyGeometries = saved.at("emptyGeometries").get<std::size_t>();
+      }
+
+      invalidAttributes_ =
+         value.at("invalidAttributes").get<std::vector<std::pair<std::string, std::string>>>();
+      unknownGeometryTypes_ = value.at("unknownGeometryTypes").get<std::vector<std::string>>();
+   }
+   catch (json::exception&)
+   {
+      clear();
+      return false;
+   }
+   return true;
+}
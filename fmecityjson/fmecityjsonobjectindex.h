@@ -0,0 +1,192 @@
+#ifndef FME_CITY_JSON_OBJECT_INDEX_H
+#define FME_CITY_JSON_OBJECT_INDEX_H
+/*=============================================================================
+
+   Name     : fmecityjsonobjectindex.h
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Declaration of FMECityJSONObjectIndex
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "fmecityjsonbox.h"
+
+#include <nlohmann/json.hpp>
+// for convenience
+using json = nlohmann::json;
+
+// A quick 64-bit hash of a file's contents.  Reading all of a huge file just to
+// check if it changed would defeat the purpose, so this hashes the start, the end,
+// and evenly spaced blocks in between.  An edit that keeps the size and lands
+// between the blocks, with the modified time put back, gets past it.
+std::uint64_t hashFileSample(const char* data, std::size_t size);
+
+// The same hash over every byte of the file, for when that isn't good enough.
+std::uint64_t hashFileContents(const char* data, std::size_t size);
+
+// -----------------------------------------------------------------------
+// Everything the reader needs to know about the CityObjects in a file, from a
+// single pass over them when it is opened.  It has one small entry per
+// CityObject, in the order they are read, telling us which LoDs its geometries
+// have, so we can skip objects without parsing them again.  It also sums up the
+// attributes and geometries of each feature type, which is all readSchema()
+// needs to make the schema features.
+class FMECityJSONObjectIndex
+{
+public:
+   // Only this many different LoDs fit in the lodMask.
+   static const std::size_t kMaxMaskedLods = 64;
+
+   struct Entry
+   {
+      // Bit i is set if a geometry has the LoD lodName(i).
+      std::uint64_t lodMask = 0;
+
+      // The LoD to use when reading the "Highest" LoD, as an index into
+      // lodName(), or -1 if there is no numeric one.
+      std::int32_t highestLod = -1;
+
+      // There are no geometries, or one without a LoD, so we can't skip this one.
+      bool alwaysRead = false;
+
+      // One of the LoDs didn't fit in the lodMask, so it's not the whole story.
+      bool lodMaskIncomplete = false;
+
+      // The "type" of the CityObject, as an index into typeName(), or -1 if it has none.
+      std::int32_t typeId = -1;
+   };
+
+   struct FeatureType
+   {
+      // Attribute names and their schema types, in the order we first saw them.
+      // If an attribute shows up with different types, the last one wins.
+      std::vector<std::pair<std::string, std::string>> attributes;
+
+      // The value of each "fme_geometry{i}".  Again, the last one wins.
+      std::map<int, std::string> geometries;
+
+      // How many CityObjects of this type had no geometry.
+      std::size_t emptyGeometries = 0;
+
+      // Record the type of an attribute.
+      void setAttributeType(const std::string& name, const std::string& type);
+
+   private:
+      // Where each attribute is in the list.
+      std::unordered_map<std::string, std::size_t> attributeIndex_;
+   };
+
+   void clear();
+
+   // Add the next CityObject.
+   void add(const Entry& entry) { entries_.push_back(entry); }
+   std::size_t size() const { return entries_.size(); }
+   const Entry& entry(std::size_t i) const { return entries_[i]; }
+
+   // The 2D bounding box of each CityObject, if we were asked to work them out.
+   // There is one for each entry, in the same order.
+   void setBoxes(std::vector<FMECityJSONBox> boxes) { boxes_ = std::move(boxes); }
+   bool hasBoxes() const { return boxes_.size() == entries_.size(); }
+   const FMECityJSONBox& box(std::size_t i) const { return boxes_[i]; }
+   const std::vector<FMECityJSONBox>& boxes() const { return boxes_; }
+
+   // The parents and children of each CityObject, as positions in the index.
+   // Each (parent, child) pair may be given more than once, as both the parent
+   // and the child usually list it.  We only keep these along with the boxes.
+   using Range = std::pair<const std::size_t*, const std::size_t*>;
+   void setRelations(std::vector<std::pair<std::size_t, std::size_t>> parentChild);
+   Range parents(std::size_t i) const { return parents_.range(i); }
+   Range children(std::size_t i) const { return children_.range(i); }
+
+   // The number we give this LoD string.  The same string always gets the same number.
+   std::int32_t lodId(const std::string& lod);
+   const std::string& lodName(std::int32_t id) const { return lodNames_[id]; }
+
+   // Find the LoD among those we've seen.  Returns -1 if it isn't there.
+   std::int32_t findLod(const std::string& lod) const;
+
+   // The same again for the CityObject types.
+   std::int32_t typeId(const std::string& type);
+   const std::string& typeName(std::int32_t id) const { return typeNames_[id]; }
+   std::size_t numTypes() const { return typeNames_.size(); }
+   std::int32_t findType(const std::string& type) const;
+
+   // Get the summary for this feature type, adding it if it is new.
+   FeatureType& featureType(const std::string& name);
+   const std::map<std::string, FeatureType>& featureTypes() const { return featureTypes_; }
+
+   // Things that didn't fit in the schema, for readSchema() to log.
+   // Each one is only recorded once.
+   void addInvalidAttribute(const std::string& name, const std::string& valueType);
+   void addUnknownGeometryType(const std::string& type);
+   const std::vector<std::pair<std::string, std::string>>& invalidAttributes() const { return invalidAttributes_; }
+   const std::vector<std::string>& unknownGeometryTypes() const { return unknownGeometryTypes_; }
+
+   // Save everything in the index as json, and get it back again.  fromJSON()
+   // returns false, and leaves the index empty, if the json doesn't make sense.
+   json toJSON() const;
+   bool fromJSON(const json& value);
+
+private:
+   std::vector<Entry> entries_;
+   std::vector<FMECityJSONBox> boxes_;
+
+   // A list of entries for each entry: the ones for entry i are
+   // values[start[i] .. start[i + 1]).
+   struct Lists
+   {
+      std::vector<std::size_t> start;
+      std::vector<std::size_t> values;
+
+      Range range(std::size_t i) const;
+   };
+   Lists parents_;
+   Lists children_;
+
+   std::vector<std::string> lodNames_;
+   std::unordered_map<std::string, std::int32_t> lodIds_;
+
+   std::vector<std::string> typeNames_;
+   std::unordered_map<std::string, std::int32_t> typeIds_;
+
+   std::map<std::string, FeatureType> featureTypes_;
+
+   std::vector<std::pair<std::string, std::string>> invalidAttributes_;
+   std::vector<std::string> unknownGeometryTypes_;
+};
+
+#endif
@@ -0,0 +1,629 @@
+/*=============================================================================
+
+   Name     : fmecityjsonparser.cpp
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Implementation of the JSON parser backends
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+// Include Files
+#include "fmecityjsonparser.h"
+
+#include <atomic>
+
+#ifdef FME_CITYJSON_SIMDJSON
+#include <simdjson.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#endif
+
+//===========================================================================
+// The nlohmann backend.  This is the one the reader has always used.
+class FMECityJSONNlohmannParser : public FMECityJSONParser
+{
+public:
+   const char* name() const override { return kParserNlohmann; }
+
+   bool parseDocument(const FMECityJSONMappedFile& file,
+                      std::size_t offset,
+                      std::size_t length,
+                      json& document,
+                      VertexPool3D& vertices,
+                      std::string& errorMessage) override
+   {
+      badVertices_ = 0;
+      if (not parseValue(file, offset, length, document, errorMessage))
+      {
+         return false;
+      }
+      if (not document.is_object())
+      {
+         errorMessage = "the root is not a JSON object";
+         return false;
+      }
+
+      // Move the vertices over to the pool, and drop them from the document.
+      auto vertexArray = document.find("vertices");
+      if (vertexArray != document.end())
+      {
+         // The json array is only read from here, so big ones can be
+         // decoded in chunks on several threads at once.  A vertex that isn't
+         // an array of numbers throws, and the throw comes back to us here.
+         const std::size_t first = vertices.size();
+         const json& vertexJSON  = *vertexArray;
+         if (not vertexJSON.is_array())
+         {
+            errorMessage = "the vertices are not an array";
+            return false;
+         }
+         vertices.resize(first + vertexJSON.size());
+         std::atomic<bool> failed(false);
+         std::atomic<std::size_t> badVertices(0);
+         auto decode = [&](std::size_t begin, std::size_t end)
+         {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+               double coords[3];
+               if (not decodeVertex(vertexJSON[i], coords)) ++badVertices;
+               if (not vertices.set(first + i, coords[0], coords[1], coords[2]))
+               {
+                  failed = true;
+                  return;
+               }
+            }
+         };
+         try
+         {
+            forEachChunk(vertexJSON.size(), decode);
+
+            // If they weren't all integers, go again, as doubles this time.
+            if (failed)
+            {
+               vertices.toDoubles();
+               badVertices = 0;
+               forEachChunk(vertexJSON.size(), decode);
+            }
+         }
+         catch (json::exception& e)
+         {
+            errorMessage = e.what();
+            return false;
+         }
+         badVertices_  = badVertices;
+         *vertexArray = json::array();
+      }
+      return true;
+   }
+
+   bool scanDocument(const FMECityJSONMappedFile& file,
+                     std::size_t offset,
+                     std::size_t length,
+                     json& document,
+                     VertexPool3D& vertices,
+                     std::vector<CityObjectSpan>& cityObjectSpans,
+                     std::string& errorMessage) override
+   {
+      badVertices_ = 0;
+      const char* start = file.begin() + offset;
+      const std::size_t firstSpan = cityObjectSpans.size();
+      std::size_t bytesRead(0);
+      FMECityJSONStreamScanner scanner(document, vertices, cityObjectSpans, start, bytesRead);
+      CountingIterator first(start, &bytesRead);
+      CountingIterator last(start + length, nullptr);
+      if (not json::sax_parse(first, last, &scanner))
+      {
+         errorMessage = scanner.errorMessage();
+         return false;
+      }
+      badVertices_ = scanner.badVertices();
+      if (not document.is_object())
+      {
+         errorMessage = "the root is not a JSON object";
+         return false;
+      }
+
+      // The scanner counts from the start of what it was given.
+      for (std::size_t i = firstSpan; i < cityObjectSpans.size(); ++i)
+      {
+         cityObjectSpans[i].offset += offset;
+      }
+      return true;
+   }
+
+   bool parseValue(const FMECityJSONMappedFile& file,
+                   std::size_t offset,
+                   std::size_t length,
+                   json& value,
+                   std::string& errorMessage) override
+   {
+      const char* start = file.begin() + offset;
+      try
+      {
+         value = json::parse(start, start + length);
+      }
+      catch (json::parse_error& e)
+      {
+         errorMessage = e.what();
+         return false;
+      }
+      return true;
+   }
+};
+
+#ifdef FME_CITYJSON_SIMDJSON
+
+//===========================================================================
+// Convert a simdjson on-demand value to nlohmann json.  We keep the number types
+// exactly as nlohmann would have parsed them, so the features come out the same:
+// non-negative integers are unsigned, and integers too big for 64 bits are doubles.
+static simdjson::error_code toJSON(simdjson::ondemand::value value, json& out)
+{
+   simdjson::ondemand::json_type type;
+   simdjson::error_code error = value.type().get(type);
+   if (error) return error;
+
+   switch (type)
+   {
+   case simdjson::ondemand::json_type::object:
+   {
+      simdjson::ondemand::object object;
+      error = value.get_object().get(object);
+      if (error) return error;
+      out = json::object();
+      for (auto field : object)
+      {
+         std::string_view key;
+         error = field.unescaped_key().get(key);
+         if (error) return error;
+         simdjson::ondemand::value child;
+         error = field.value().get(child);
+         if (error) return error;
+         error = toJSON(child, out[std::string(key)]);
+         if (error) return error;
+      }
+      return simdjson::SUCCESS;
+   }
+   case simdjson::ondemand::json_type::array:
+   {
+      simdjson::ondemand::array array;
+      error = value.get_array().get(array);
+      if (error) return error;
+      out = json::array();
+      for (auto element : array)
+      {
+         simdjson::ondemand::value child;
+         error = element.get(child);
+         if (error) return error;
+         out.emplace_back();
+         error = toJSON(child, out.back());
+         if (error) return error;
+      }
+      return simdjson::SUCCESS;
+   }
+   case simdjson::ondemand::json_type::number:
+   {
+      simdjson::ondemand::number_type numberType;
+      error = value.get_number_type().get(numberType);
+      if (error) return error;
+      switch (numberType)
+      {
+      case simdjson::ondemand::number_type::signed_integer:
+      {
+         std::int64_t i;
+         error = value.get_int64().get(i);
+         if (error) return error;
+         if (i >= 0)
+            out = static_cast<std::uint64_t>(i);
+         else
+            out = i;
+         return simdjson::SUCCESS;
+      }
+      case simdjson::ondemand::number_type::unsigned_integer:
+      {
+         std::uint64_t u;
+         error = value.get_uint64().get(u);
+         if (error) return error;
+         out = u;
+         return simdjson::SUCCESS;
+      }
+      case simdjson::ondemand::number_type::floating_point_number:
+      {
+         double d;
+         error = value.get_double().get(d);
+         if (error) return error;
+         out = d;
+         return simdjson::SUCCESS;
+      }
+      default:
+      {
+         // A big integer, which nlohmann turns into a double.
+         std::string token(value.raw_json_token());
+         out = std::strtod(token.c_str(), nullptr);
+         return simdjson::SUCCESS;
+      }
+      }
+   }
+   case simdjson::ondemand::json_type::string:
+   {
+      std::string_view s;
+      error = value.get_string().get(s);
+      if (error) return error;
+      out = std::string(s);
+      return simdjson::SUCCESS;
+   }
+   case simdjson::ondemand::json_type::boolean:
+   {
+      bool b;
+      error = value.get_bool().get(b);
+      if (error) return error;
+      out = b;
+      return simdjson::SUCCESS;
+   }
+   case simdjson::ondemand::json_type::null:
+   {
+      out = nullptr;
+      return simdjson::SUCCESS;
+   }
+   default:
+      return simdjson::INCORRECT_TYPE;
+   }
+}
+
+//===========================================================================
+// Decode the "vertices" array straight into doubles.
+static simdjson::error_code readVertices(simdjson::ondemand::value value,
+                                         VertexPool3D& vertices,
+                                         std::size_t& badVertices)
+{
+   simdjson::ondemand::array vertexArray;
+   simdjson::error_code error = value.get_array().get(vertexArray);
+   if (error) return error;
+
+   for (auto vtx : vertexArray)
+   {
+      simdjson::ondemand::array coordArray;
+      error = vtx.get_array().get(coordArray);
+      if (error) return error;
+
+      double coords[3] = {0.0, 0.0, 0.0};
+      std::size_t numCoords(0);
+      for (auto coord : coordArray)
+      {
+         double c;
+         error = coord.get_double().get(c);
+         if (error) return error;
+         if (numCoords < 3) coords[numCoords] = c;
+         ++numCoords;
+      }
+      if (numCoords != 3) ++badVertices;
+      vertices.emplace_back(coords[0], coords[1], coords[2]);
+   }
+   return simdjson::SUCCESS;
+}
+
+//===========================================================================
+// Read the "transform" with the numbers straight into doubles.  Anything that
+// isn't what we expect is kept as it is, so the reader can complain about it.
+static simdjson::error_code readTransform(simdjson::ondemand::value value, json& out)
+{
+   simdjson::ondemand::object object;
+   simdjson::error_code error = value.get_object().get(object);
+   if (error == simdjson::INCORRECT_TYPE) return toJSON(value, out);
+   if (error) return error;
+
+   out = json::object();
+   for (auto field : object)
+   {
+      std::string_view key;
+      error = field.unescaped_key().get(key);
+      if (error) return error;
+      simdjson::ondemand::value child;
+      error = field.value().get(child);
+      if (error) return error;
+
+      json& member = out[std::string(key)];
+      simdjson::ondemand::array array;
+      if (key != "scale" and key != "translate")
+      {
+         error = toJSON(child, member);
+      }
+      else if ((error = child.get_array().get(array)) == simdjson::INCORRECT_TYPE)
+      {
+         error = toJSON(child, member);
+      }
+      else if (not error)
+      {
+         member = json::array();
+         for (auto element : array)
+         {
+            simdjson::ondemand::value number;
+            error = element.get(number);
+            if (error) return error;
+            double d;
+            error = number.get_double().get(d);
+            if (error == simdjson::INCORRECT_TYPE)
+            {
+               member.emplace_back();
+               error = toJSON(number, member.back());
+            }
+            else if (not error)
+            {
+               member.push_back(d);
+            }
+            if (error) return error;
+         }
+      }
+      if (error) return error;
+   }
+   return simdjson::SUCCESS;
+}
+
+//===========================================================================
+// Find where each CityObject is, without parsing it.  simdjson gives us views of
+// the buffer it parsed, which may be a padded copy, so we turn those back into
+// offsets in the file.  Like the stream scanner, anything in there that isn't an
+// object is skipped.
+static simdjson::error_code readCityObjectSpans(simdjson::ondemand::value value,
+                                                const char* parsed,
+                                                const char* file,
+                                                std::size_t offset,
+                                                std::vector<CityObjectSpan>& cityObjectSpans)
+{
+   simdjson::ondemand::object object;
+   simdjson::error_code error = value.get_object().get(object);
+   if (error) return error;
+
+   for (auto field : object)
+   {
+      std::string_view id;
+      error = field.escaped_key().get(id);
+      if (error) return error;
+      simdjson::ondemand::value cityObject;
+      error = field.value().get(cityObject);
+      if (error) return error;
+      simdjson::ondemand::json_type type;
+      error = cityObject.type().get(type);
+      if (error) return error;
+      if (type != simdjson::ondemand::json_type::object) continue;
+
+      std::string_view raw;
+      error = cityObject.raw_json().get(raw);
+      if (error) return error;
+      while (not raw.empty() and std::strchr(" \t\r\n", raw.back()))
+      {
+         raw.remove_suffix(1); // simdjson leaves the whitespace after it on
+      }
+      const std::size_t idOffset = offset + (id.data() - parsed);
+      cityObjectSpans.push_back({std::string_view(file + idOffset, id.size()),
+                                 offset + (raw.data() - parsed),
+                                 raw.size()});
+   }
+   return simdjson::SUCCESS;
+}
+
+//===========================================================================
+// The simdjson backend, using the on-demand API.  It parses straight from the
+// mapped file when the mapping has enough room after the end of the file for
+// simdjson's padding, and from a padded copy when it does not.
+class FMECityJSONSimdjsonParser : public FMECityJSONParser
+{
+public:
+   const char* name() const override { return kParserSimdjson; }
+
+   bool parseDocument(const FMECityJSONMappedFile& file,
+                      std::size_t offset,
+                      std::size_t length,
+                      json& document,
+                      VertexPool3D& vertices,
+                      std::string& errorMessage) override
+   {
+      badVertices_ = 0;
+      simdjson::padded_string copy;
+      simdjson::padded_string_view view = paddedView(file, offset, length, copy);
+
+      simdjson::ondemand::document doc;
+      simdjson::error_code error = parser_.iterate(view).get(doc);
+      if (not error) error = readDocument(doc, document, vertices, badVertices_, nullptr);
+      if (not error and not doc.at_end()) error = simdjson::TRAILING_CONTENT;
+      if (error)
+      {
+         errorMessage = simdjson::error_message(error);
+         return false;
+      }
+      return true;
+   }
+
+   bool scanDocument(const FMECityJSONMappedFile& file,
+                     std::size_t offset,
+                     std::size_t length,
+                     json& document,
+                     VertexPool3D& vertices,
+                     std::vector<CityObjectSpan>& cityObjectSpans,
+                     std::string& errorMessage) override
+   {
+      badVertices_ = 0;
+      simdjson::padded_string copy;
+      simdjson::padded_string_view view = paddedView(file, offset, length, copy);
+
+      SpanOutput spans{view.data(), file.begin(), offset, cityObjectSpans};
+      simdjson::ondemand::document doc;
+      simdjson::error_code error = parser_.iterate(view).get(doc);
+      if (not error) error = readDocument(doc, document, vertices, badVertices_, &spans);
+      if (not error and not doc.at_end()) error = simdjson::TRAILING_CONTENT;
+      if (error)
+      {
+         errorMessage = simdjson::error_message(error);
+         return false;
+      }
+      return true;
+   }
+
+   bool parseValue(const FMECityJSONMappedFile& file,
+                   std::size_t offset,
+                   std::size_t length,
+                   json& value,
+                   std::string& errorMessage) override
+   {
+      simdjson::padded_string copy;
+      simdjson::padded_string_view view = paddedView(file, offset, length, copy);
+
+      simdjson::ondemand::document doc;
+      simdjson::ondemand::value root;
+      simdjson::error_code error = parser_.iterate(view).get(doc);
+      if (not error) error = doc.get_value().get(root);
+      if (error == simdjson::SCALAR_DOCUMENT_AS_VALUE)
+      {
+         // simdjson won't give us a lone number, string etc. as a value, such as
+         // the "version" when reading only some CityObject IDs.  It's tiny, so
+         // let nlohmann have it.
+         return FMECityJSONNlohmannParser().parseValue(file, offset, length, value, errorMessage);
+      }
+      if (not error) error = toJSON(root, value);
+      if (not error and not doc.at_end()) error = simdjson::TRAILING_CONTENT;
+      if (error)
+      {
+         errorMessage = simdjson::error_message(error);
+         return false;
+      }
+      return true;
+   }
+
+private:
+   // simdjson needs SIMDJSON_PADDING readable bytes after the part we are parsing.
+   // Usually the rest of the file, or the end of the last page of the mapping, gives
+   // us that for free.  Otherwise we need to make a padded copy.
+   static simdjson::padded_string_view paddedView(const FMECityJSONMappedFile& file,
+                                                  std::size_t offset,
+                                                  std::size_t length,
+                                                  simdjson::padded_string& copy)
+   {
+      std::size_t readable = file.size() - offset;
+      if (file.isPaddedBy(simdjson::SIMDJSON_PADDING))
+      {
+         readable += simdjson::SIMDJSON_PADDING;
+      }
+      if (readable >= length + simdjson::SIMDJSON_PADDING)
+      {
+         return simdjson::padded_string_view(file.begin() + offset, length, readable);
+      }
+
+      copy = simdjson::padded_string(file.begin() + offset, length);
+      return simdjson::padded_string_view(copy);
+   }
+
+   // Where the CityObject spans go when scanning, and what we need to know to
+   // turn simdjson's views into offsets in the file.
+   struct SpanOutput
+   {
+      const char* parsed;
+      const char* file;
+      std::size_t offset;
+      std::vector<CityObjectSpan>& cityObjectSpans;
+   };
+
+   // With spans, the CityObjects are only located, otherwise they are parsed.
+   static simdjson::error_code readDocument(simdjson::ondemand::document& doc,
+                                            json& document,
+                                            VertexPool3D& vertices,
+                                            std::size_t& badVertices,
+                                            SpanOutput* spans)
+   {
+      simdjson::ondemand::object root;
+      simdjson::error_code error = doc.get_object().get(root);
+      if (error) return error;
+
+      document = json::object();
+      for (auto field : root)
+      {
+         std::string_view key;
+         error = field.unescaped_key().get(key);
+         if (error) return error;
+         simdjson::ondemand::value value;
+         error = field.value().get(value);
+         if (error) return error;
+
+         if (key == "vertices")
+         {
+            error = readVertices(value, vertices, badVertices);
+            document["vertices"] = json::array();
+         }
+         else if (key == "transform")
+         {
+            error = readTransform(value, document["transform"]);
+         }
+         else if (key == "CityObjects" and spans)
+         {
+            error = readCityObjectSpans(
+               value, spans->parsed, spans->file, spans->offset, spans->cityObjectSpans);
+            document["CityObjects"] = json::object();
+         }
+         else
+         {
+            error = toJSON(value, document[std::string(key)]);
+         }
+         if (error) return error;
+      }
+      return simdjson::SUCCESS;
+   }
+
+   simdjson::ondemand::parser parser_;
+};
+
+#endif
+
+//===========================================================================
+bool decodeVertex(const json& vertex, double coords[3])
+{
+   if (not vertex.is_array())
+   {
+      throw json::type_error::create(302, "a vertex is not an array", &vertex);
+   }
+   coords[0] = coords[1] = coords[2] = 0.0;
+   for (std::size_t i = 0; i < 3 and i < vertex.size(); ++i)
+   {
+      coords[i] = vertex[i].get<double>();
+   }
+   return vertex.size() == 3;
+}
+
+//===========================================================================
+std::unique_ptr<FMECityJSONParser> createCityJSONParser(const std::string& name)
+{
+#ifdef FME_CITYJSON_SIMDJSON
+   if (name == kParserSimdjson)
+   {
+      return std::unique_ptr<FMECityJSONParser>(new FMECityJSONSimdjsonParser());
+   }
+#else
+   (void)name; // there's only the one backend
+#endif
+   return std::unique_ptr<FMECityJSONParser>(new FMECityJSONNlohmannParser());
+}
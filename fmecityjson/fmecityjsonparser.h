@@ -0,0 +1,121 @@
+#ifndef FME_CITY_JSON_PARSER_H
+#define FME_CITY_JSON_PARSER_H
+/*=============================================================================
+
+   Name     : fmecityjsonparser.h
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Declaration of the JSON parser backends
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+#include "fmecityjsonmappedfile.h"
+#include "fmecityjsonstreamscanner.h"
+#include "fmecityjsonvertexpool.h"
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+// for convenience
+using json         = nlohmann::json;
+using VertexPool3D = FMECityJSONVertexPool;
+
+// The names of the parser backends, as used in the reader's JSON_PARSER parameter.
+const static char* const kParserNlohmann = "nlohmann";
+const static char* const kParserSimdjson = "simdjson";
+
+// -----------------------------------------------------------------------
+// The reader talks to the JSON parser only through this, so we can swap in a
+// faster parser for big files.  Whichever backend is used, what comes out is the
+// same nlohmann json the rest of the reader works with, except for the vertices,
+// which are decoded straight into doubles.
+class FMECityJSONParser
+{
+public:
+   virtual ~FMECityJSONParser() {}
+
+   // The name of this backend.
+   virtual const char* name() const = 0;
+
+   // Parse a whole CityJSON document, CityObjects and all, found at this part of
+   // the file.  That's usually the whole file, or one line of a CityJSON Text
+   // Sequence.  The "vertices" are not kept in the document, they go straight into
+   // the vertex pool before any transform is applied.  A vertex with fewer than 3
+   // coordinates gets 0 for the missing ones, extra ones are dropped, and either
+   // way it is counted in badVertices().  Returns false, with a message, if it
+   // could not be parsed.
+   virtual bool parseDocument(const FMECityJSONMappedFile& file,
+                              std::size_t offset,
+                              std::size_t length,
+                              json& document,
+                              VertexPool3D& vertices,
+                              std::string& errorMessage) = 0;
+
+   // Like parseDocument(), but the CityObjects are not parsed.  We only find
+   // where each one is in the file and add that to cityObjectSpans, leaving an
+   // empty "CityObjects" in the document, so they can be parsed one at a time
+   // later.  This is how the reader streams the CityObjects.
+   virtual bool scanDocument(const FMECityJSONMappedFile& file,
+                             std::size_t offset,
+                             std::size_t length,
+                             json& document,
+                             VertexPool3D& vertices,
+                             std::vector<CityObjectSpan>& cityObjectSpans,
+                             std::string& errorMessage) = 0;
+
+   // Parse a single JSON value found at this part of the file, such as one
+   // CityObject that the stream scanner has located.
+   virtual bool parseValue(const FMECityJSONMappedFile& file,
+                           std::size_t offset,
+                           std::size_t length,
+                           json& value,
+                           std::string& errorMessage) = 0;
+
+   // How many vertices in the last parseDocument() did not have exactly 3 coordinates.
+   std::size_t badVertices() const { return badVertices_; }
+
+protected:
+   std::size_t badVertices_ = 0;
+};
+
+// Get the coordinates of one vertex out of its json array.  Like everywhere else
+// we read vertices, missing coordinates are 0 and extra ones are dropped, and it
+// returns false if either happened.  Throws a json::exception if the vertex
+// isn't an array of numbers.
+bool decodeVertex(const json& vertex, double coords[3]);
+
+// -----------------------------------------------------------------------
+// Create the parser backend with the given name.  If that backend was not built
+// into this plug-in, you get the nlohmann one instead, so check name().
+std::unique_ptr<FMECityJSONParser> createCityJSONParser(const std::string& name);
+
+#endif
@@ -46,6 +46,8 @@ const static char* const kMsgClosingReader = "Closing reader on dataset ";
 const static char* const kMsgOpeningWriter = "Opening writer on dataset ";
 const static char* const kMsgClosingWriter = "Closing writer on dataset ";
 const static char* const kMsgWriteError    = "Error writing geometry";
+const static char* const kMsgCoordinateTooLarge =
+   "This coordinate is too large to write with the number of important digits asked for: ";
 
 const static char* const kMsgStartVisiting = "Starting visit to geometry type ";
 const static char* const kMsgVisiting      = "Visiting geometry type ";
@@ -54,6 +56,43 @@ const static char* const kMsgEndVisiting   = "Finishing visit to geometry type "
 const static char* const kLodParamTag      = "'CityJSON Level of Detail' parameter value: ";
 const static char* const kSrcLodParamTag   = "_LOD";
 const static char* const kMsgNoLodParam    = "'CityJSON Level of Detail' parameter value is not set";
+const static char* const kMsgBadTransform =
+   "The 'transform' needs a 'scale' and a 'translate', each an array of 3 numbers";
+
+const static char* const kStreamParamTag    = "'Stream CityObjects' parameter value: ";
+const static char* const kSrcStreamParamTag = "_STREAM_CITYOBJECTS";
+
+const static char* const kParserParamTag    = "'JSON Parser' parameter value: ";
+const static char* const kSrcParserParamTag = "_JSON_PARSER";
+
+const static char* const kIndexCacheParamTag    = "'Cache CityObject Index' parameter value: ";
+const static char* const kSrcIndexCacheParamTag = "_CACHE_INDEX";
+
+const static char* const kIndexCacheFullHashParamTag    = "'Check the Whole File Against the Index Cache' parameter value: ";
+const static char* const kSrcIndexCacheFullHashParamTag = "_CACHE_INDEX_FULL_HASH";
+
+const static char* const kIdsToReadParamTag    = "'CityObject IDs to Read' parameter value: ";
+const static char* const kSrcIdsToReadParamTag = "_IDS_TO_READ";
+
+const static char* const kTypesToReadParamTag    = "'CityObject Types to Read' parameter value: ";
+const static char* const kSrcTypesToReadParamTag = "_TYPES_TO_READ";
+
+const static char* const kAttributesToReadParamTag    = "'Attributes to Read' parameter value: ";
+const static char* const kSrcAttributesToReadParamTag = "_ATTRIBUTES_TO_READ";
+
+const static char* const kSearchEnvelopeParamTag    = "Search envelope: ";
+const static char* const kSrcSearchEnvelopeParamTag = "_SEARCH_ENVELOPE";
+
+const static char* const kEnvelopeNoGeometryParamTag = "'Search Envelope: CityObjects Without Geometry' parameter value: ";
+const static char* const kSrcEnvelopeNoGeometryParamTag = "_SEARCH_ENVELOPE_NO_GEOMETRY";
+
+const static char* const kEnvelopeRelativesParamTag = "'Search Envelope: Parents and Children' parameter value: ";
+const static char* const kSrcEnvelopeRelativesParamTag = "_SEARCH_ENVELOPE_RELATIVES";
+
+// What setConstraints() is asked for.
+const static char* const kFMESearchType         = "fme_search_type";
+const static char* const kFMEEnvelopeIntersects = "fme_envelope_intersects";
+const static char* const kFMEAllFeatures        = "fme_all_features";
 
 const static char* const kSrcCityjsonVersion  = "_CITYJSON_VERSION";
 const static char* const kSrcRemoveDuplicates = "_REMOVE_DUPLICATES";
@@ -63,6 +102,11 @@ const static char* const kSrcIndentSize       = "_INDENT_SIZE";
 const static char* const kSrcIndentCharacters = "_INDENT_CHARACTERS";
 const static char* const kSrcPrettyPrint      = "_PRETTY_PRINT";
 const static char* const kSrcPreferredTextureFormat = "_TEXTURE_OUTPUT_FORMAT";
+const static char* const kSrcWriteIncrementally = "_WRITE_INCREMENTALLY";
+const static char* const kSrcCopyUnchangedTextures = "_COPY_UNCHANGED_TEXTURES";
+
+// The first CityJSON version with CityJSONFeatures, for Text Sequences.
+const static char* const kSequenceMinVersion = "1.1";
 
 // Used when the writer is looking for schema features from the reader
 const static char* const kCityJSON_FME_DIRECTION    = "FME_DIRECTION";
@@ -0,0 +1,203 @@
+#ifndef FME_CITY_JSON_QUANTIZED_INDEX_H
+#define FME_CITY_JSON_QUANTIZED_INDEX_H
+/*=============================================================================
+
+   Name     : fmecityjsonquantizedindex.h
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Declaration of FMECityJSONQuantizedIndex
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// -----------------------------------------------------------------------
+// Turn a coordinate into an integer number of 10^-digits units.  Two values
+// that would print the same with this many fractional digits get the same
+// integer, which makes it a good key for spotting duplicates.  NaN (a missing
+// Z, for example) gets its own value so it can still be part of a key.
+// Returns false if the value is infinite, or is too big to fit in 64 bits with
+// this many digits, and then quantized is left alone.
+const static std::int64_t kQuantizedNaN = std::numeric_limits<std::int64_t>::min();
+
+inline bool quantizeCoordinate(double value, double multiplier, std::int64_t& quantized)
+{
+   if (std::isnan(value))
+   {
+      quantized = kQuantizedNaN;
+      return true;
+   }
+
+   // The product is rounded, which matters only when it lands right on a half.
+   // In that case the rounding error tells us which way the exact value was,
+   // so we still agree with what printf("%.*f") would give.
+   const double product = value * multiplier;
+   double rounded = std::round(product);
+   if (std::fabs(product - std::trunc(product)) == 0.5)
+   {
+      const double error = std::fma(value, multiplier, -product);
+      if (error > 0.0)
+      {
+         rounded = std::ceil(product);
+      }
+      else if (error < 0.0)
+      {
+         rounded = std::floor(product);
+      }
+      else
+      {
+         rounded = std::nearbyint(product); // a true tie, round half to even
+      }
+   }
+
+   // 2^63 is exact as a double.  -2^63 would fit, but it's kQuantizedNaN.
+   const double kLimit = 9223372036854775808.0;
+   if (!(std::fabs(rounded) < kLimit))
+   {
+      return false;
+   }
+   quantized = std::int64_t(rounded);
+   return true;
+}
+
+// ...and back again.
+inline double dequantizeCoordinate(std::int64_t value, double multiplier)
+{
+   if (value == kQuantizedNaN)
+   {
+      return std::numeric_limits<double>::quiet_NaN();
+   }
+   return double(value) / multiplier;
+}
+
+// -----------------------------------------------------------------------
+// Maps a quantized point (N integers) to its index in a pool.
+// This is a small open addressing hash table with linear probing.  The
+// keys are just integers, so we don't need to allocate anything per entry,
+// unlike when we used stringified coordinates in a std::unordered_map.
+template <std::size_t N>
+class FMECityJSONQuantizedIndex
+{
+public:
+   using Key = std::array<std::int64_t, N>;
+
+   FMECityJSONQuantizedIndex() : size_(0) {}
+
+   // If the key is already in the index, return its index and false.
+   // Otherwise add it with newIndex, and return newIndex and true.
+   std::pair<unsigned long, bool> tryEmplace(const Key& key, unsigned long newIndex)
+   {
+      // Keep the table at most half full, so the probe chains stay short.
+      if ((size_ + 1) * 2 > slots_.size())
+      {
+         grow();
+      }
+
+      const std::size_t mask = slots_.size() - 1;
+      for (std::size_t i = hash(key) & mask;; i = (i + 1) & mask)
+      {
+         Slot& slot = slots_[i];
+         if (!slot.used)
+         {
+            slot.key   = key;
+            slot.index = newIndex;
+            slot.used  = true;
+            size_++;
+            return {newIndex, true};
+         }
+         if (slot.key == key)
+         {
+            return {slot.index, false};
+         }
+      }
+   }
+
+   void clear()
+   {
+      slots_.clear();
+      size_ = 0;
+   }
+
+   std::size_t size() const { return size_; }
+
+private:
+   struct Slot
+   {
+      Key key;
+      unsigned long index;
+      bool used = false;
+   };
+
+   // A 64-bit mix (from splitmix64) of each component, so points that
+   // are close together don't all end up in neighbouring slots.
+   static std::size_t hash(const Key& key)
+   {
+      std::uint64_t h = 0x9E3779B97F4A7C15ULL;
+      for (std::int64_t v : key)
+      {
+         std::uint64_t x = std::uint64_t(v) + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+         x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+         x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+         h ^= x ^ (x >> 31);
+      }
+      return std::size_t(h);
+   }
+
+   void grow()
+   {
+      std::vector<Slot> old;
+      old.swap(slots_);
+      slots_.resize(old.empty() ? 64 : old.size() * 2);
+
+      const std::size_t mask = slots_.size() - 1;
+      for (const Slot& slot : old)
+      {
+         if (slot.used)
+         {
+            std::size_t i = hash(slot.key) & mask;
+            while (slots_[i].used)
+            {
+               i = (i + 1) & mask;
+            }
+            slots_[i] = slot;
+         }
+      }
+   }
+
+   std::vector<Slot> slots_;
+   std::size_t size_;
+};
+
+#endif
@@ -36,6 +36,8 @@
 // Include Files
 #include "fmecityjsonreader.h"
 #include "fmecityjsonpriv.h"
+#include "fmecityjsonstreamscanner.h"
+#include "fmecityjsonstructuralscan.h"
 
 #include <igeometrytools.h>
 #include <ilogfile.h>
@@ -59,9 +61,61 @@
 #include <sstream>
 #include <iomanip>
 #include <filesystem>
+#include <cstring>
+#include <string_view>
 
 // These are initialized externally when a reader object is created so all
 // methods in this file can assume they are ready to use.
+namespace
+{
+   //===========================================================================
+   // Stands in for anything that isn't there, so we can look things up in a
+   // const json without the non-const operator[] adding nulls to it.
+   const json& nullJSON()
+   {
+      static const json null;
+      return null;
+   }
+
+   //===========================================================================
+   // The member of an object, or null if it isn't an object or doesn't have it.
+   const json& member(const json& object, const char* key)
+   {
+      if (not object.is_object())
+      {
+         return nullJSON();
+      }
+      auto found = object.find(key);
+      return (found == object.end()) ? nullJSON() : *found;
+   }
+
+   //===========================================================================
+   // An element of an array, or null if it isn't an array or it's too short.
+   const json& element(const json& array, std::size_t index)
+   {
+      return (array.is_array() and index < array.size()) ? array[index] : nullJSON();
+   }
+
+   //===========================================================================
+   // Split a comma separated list from a parameter.  We don't care about spaces
+   // around the values, and leave out empty ones.
+   void splitList(const std::string& list, std::unordered_set<std::string>& values)
+   {
+      values.clear();
+      std::stringstream stream(list);
+      std::string value;
+      while (std::getline(stream, value, ','))
+      {
+         value.erase(0, value.find_first_not_of(" \t"));
+         value.erase(value.find_last_not_of(" \t") + 1);
+         if (not value.empty())
+         {
+            values.insert(value);
+         }
+      }
+   }
+}
+
 IFMELogFile* FMECityJSONReader::gLogFile             = nullptr;
 IFMEMappingFile* FMECityJSONReader::gMappingFile     = nullptr;
 IFMECoordSysManager* FMECityJSONReader::gCoordSysMan = nullptr;
@@ -285,11 +339,25 @@ FMECityJSONReader::FMECityJSONReader(const char* readerTypeName, const char* rea
      dataset_(""),
      coordSys_(""),
      fmeGeometryTools_(nullptr),
+     nextObjectIndex_(0),
+     lodParamId_(-1),
+     useIndexCache_(false),
+     indexCacheFullHash_(false),
+     envelopeReadsNoGeometry_(true),
+     envelopeReadsRelatives_(false),
+     skippedOutsideEnvelope_(0),
+     spatialIndexBuilt_(false),
      schemaScanDone_(false),
      schemaScanDoneMeta_(false),
      textureCoordUName_(nullptr),
      textureCoordVName_(nullptr),
-     writerHelperMode_(false)
+     writerHelperMode_(false),
+     streamCityObjects_(false),
+     nextSpan_(0),
+     sequenceMode_(false),
+     sequenceStart_(0),
+     nextLinePosition_(0),
+     parserParam_(kParserNlohmann)
 {
    textureCoordUName_  = gFMESession->createString();
    *textureCoordUName_ = kFME_texture_coordinate_u;
@@ -333,21 +401,70 @@ FME_Status FMECityJSONReader::open(const char* datasetName, const IFMEStringArra
    // Open the dataset here, e.g. inputFile.open(dataSetName, ios::in);
    // -----------------------------------------------------------------------
 
-   // Open up the data file.
-   inputFile_.open(dataset_, std::ios::in);
-
-   // Check that the file exists.
-   if (!inputFile_.good())
+   // Map the data file into memory, so we can parse it straight from there.
+   if (not inputFile_.open(dataset_))
    {
       gLogFile->logMessageString("Input file does not exist", FME_ERROR);
       return FME_FAILURE;
    }
 
-   // Reset the file stream and start reading.
-   inputFile_.seekg(0, std::ios::beg);
-   inputFile_.clear();
+   // Read the mapping file parameters. Always do this, otherwise the parameters are not
+   // recognized when the Reader is created in the Workspace, only when its executed.
+   // We do this to get the LOD parameter, maybe others.
+   readParametersDialog();
+
+   parser_ = createCityJSONParser(parserParam_);
+   if (parserParam_ != parser_->name())
+   {
+      gLogFile->logMessageString(("The '" + parserParam_ + "' JSON parser is not available in " +
+                                  "this build, using '" + parser_->name() + "' instead.")
+                                    .c_str(),
+                                 FME_WARN);
+   }
+
+   // CityJSON Text Sequences (.jsonl) have the header on the first line, and then
+   // one CityJSONFeature per line.
+   std::string extension = std::filesystem::path(dataset_).extension().string();
+   std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+   sequenceMode_ = (extension == ".jsonl");
 
-   inputJSON_ = json::parse(inputFile_);
+   if (sequenceMode_)
+   {
+      // Each line is parsed as it is read, so there's nothing to stream.
+      streamCityObjects_ = false;
+      FME_Status badLuck = readSequenceHeader();
+      if (badLuck) return badLuck;
+   }
+   else if (not idsToRead_.empty())
+   {
+      // This builds a document with only the CityObjects we want, which is
+      // read like any other document from here on, not streamed.
+      if (streamCityObjects_)
+      {
+         gLogFile->logMessageString("Streaming CityObjects does not apply when reading only some CityObject IDs and will be ignored.", FME_INFORM);
+         streamCityObjects_ = false;
+      }
+      FME_Status badLuck = scanForIds();
+      if (badLuck) return badLuck;
+   }
+   else if (streamCityObjects_)
+   {
+      FME_Status badLuck = scanStream();
+      if (badLuck) return badLuck;
+   }
+   else
+   {
+      inputFile_.adviseSequential();
+      std::string errorMessage;
+      if (not parser_->parseDocument(
+             inputFile_, 0, inputFile_.size(), inputJSON_, vertices_, errorMessage))
+      {
+         gLogFile->logMessageString(("Unable to parse the input file: " + errorMessage).c_str(),
+                                    FME_ERROR);
+         return FME_FAILURE;
+      }
+      logBadVertices(parser_->badVertices());
+   }
 
    // Let's make sure we're parsing this correctly.
    if (inputJSON_.at("type").get<std::string>() != "CityJSON")
@@ -367,20 +484,28 @@ FME_Status FMECityJSONReader::open(const char* datasetName, const IFMEStringArra
       return FME_FAILURE;
    }
 
-   // Reads in the entire batch of vertices for this file.
-   readVertexPool();
-
-   // Read the mapping file parameters. Always do this, otherwise the parameters are not
-   // recognized when the Reader is created in the Workspace, only when its executed.
-   // We do this to get the LOD parameter, maybe others.
-   readParametersDialog();
+   // The parser has read in the entire batch of vertices for this file, apply the transform.
+   FME_Status badLuck = readVertexPool();
+   if (badLuck) return badLuck;
 
    // Scan the LODs in the file, and match to what the reader is requesting.
    scanLODs();
 
+   if (not searchEnvelope_.empty())
+   {
+      buildSpatialIndex();
+      selectCityObjectsInEnvelope();
+   }
+
+   selectCityObjectTypes();
+
    readMetadata();
+   if (not typesToRead_.empty() and typesToRead_.count("Metadata") == 0)
+   {
+      metaObject_ = json();
+   }
 
-   FME_Status badLuck = readMaterials();
+   badLuck = readMaterials();
    if (badLuck) return badLuck;
 
    badLuck = readTextures();
@@ -393,9 +518,87 @@ FME_Status FMECityJSONReader::open(const char* datasetName, const IFMEStringArra
    if (badLuck) return badLuck;
 
    // Start by pointing to the first CityObject to read
-   nextObject_     = inputJSON_.at("CityObjects").begin();
-   skippedObjects_ = 0;
+   restartReading();
+   skippedObjects_         = 0;
+   skippedOutsideEnvelope_ = 0;
+
+   return FME_SUCCESS;
+}
+
+//===========================================================================
+void FMECityJSONReader::selectCityObjectTypes()
+{
+   readType_.clear();
+   if (typesToRead_.empty())
+   {
+      return;
+   }
+
+   readType_.assign(objectIndex_.numTypes(), false);
+   for (const std::string& type : typesToRead_)
+   {
+      const std::int32_t typeId = objectIndex_.findType(type);
+      if (typeId >= 0)
+      {
+         readType_[typeId] = true;
+      }
+      else if (type != "Metadata")
+      {
+         gLogFile->logMessageString(("There are no CityObjects of type '" + type + "' in the file.").c_str(),
+                                    FME_WARN);
+      }
+   }
+}
+
+//===========================================================================
+void FMECityJSONReader::restartReading()
+{
+   nextObject_        = inputJSON_.at("CityObjects").begin();
+   nextSpan_          = 0;
+   nextObjectIndex_   = 0;
+   nextLinePosition_  = sequenceStart_;
+   currentFeature_    = json();
+   currentCityObject_ = json();
+}
+
+//===========================================================================
+FME_Status FMECityJSONReader::setConstraints(const IFMEFeature& feature)
+{
+   IFMEString* searchType = gFMESession->createString();
+   feature.getAttribute(kFMESearchType, *searchType);
+   const std::string type = searchType->data();
+   gFMESession->destroyString(searchType);
 
+   if (type == kFMEEnvelopeIntersects)
+   {
+      FME_Real64 minX(0), maxX(0), minY(0), maxY(0);
+      feature.boundingBox(minX, maxX, minY, maxY);
+      searchEnvelope_ = FMECityJSONBox();
+      searchEnvelope_.expand(minX, minY);
+      searchEnvelope_.expand(maxX, maxY);
+
+      // The metadata has no geometry, so it is never inside an envelope.
+      metaObject_ = json();
+      buildSpatialIndex();
+      selectCityObjectsInEnvelope();
+   }
+   else if (type == kFMEAllFeatures)
+   {
+      searchEnvelope_ = FMECityJSONBox();
+      inSearchEnvelope_.clear();
+      if (typesToRead_.empty() or typesToRead_.count("Metadata") > 0)
+      {
+         metaObject_ = inputJSON_.value("metadata", json::object());
+      }
+   }
+   else
+   {
+      gLogFile->logMessageString(
+         ("The CityJSON reader does not support the search type '" + type + "'").c_str(), FME_ERROR);
+      return FME_FAILURE;
+   }
+
+   restartReading();
    return FME_SUCCESS;
 }
 
@@ -425,177 +628,203 @@ void FMECityJSONReader::readTextureVertices()
 //===========================================================================
 FME_Status FMECityJSONReader::readTextures()
 {
-   // Check for textures in the file
+   // Check for textures in the file.  We don't load any of them yet, that
+   // happens in getTextureAppearance() when a face first uses one.  Many files
+   // have lots of textures that a filtered read never gets to.
    try
    {
-      json textures = inputJSON_.at("appearance").at("textures");
+      // This will throw if there are none.
+      inputJSON_.at("appearance").at("textures");
 
-      for (int i = 0; i < textures.size(); i++)
+      // TODO: issue 71: What is the "default"?  (Not sure where to store this in FME yet.)
+      if (inputJSON_.at("appearance").contains("default-theme-texture"))
       {
-         // Get the "type"
-         std::string rasterType;
-         if (not textures[i]["type"].is_null())
-         {
-            std::string givenType = textures[i]["type"].get<std::string>();
-            // These are the only expected types for now
-            if (givenType == "PNG")
-            {
-               rasterType = "PNGRASTER";
-            }
-            else if (givenType == "JPG")
-            {
-               rasterType = "JPEG";
-            }
-         }
+         defaultThemeTexture_ =
+            inputJSON_.at("appearance").at("default-theme-texture").get<std::string>();
+      }
+   }
+   catch (json::out_of_range& e)
+   {
+      gLogFile->logMessageString("The file does not contain any texture definitions.", FME_INFORM);
+   }
+   return FME_SUCCESS;
+}
 
-         // Get the "image"
-         IFMERaster* raster(nullptr);
-         std::string iName;
-         if (not textures[i]["image"].is_null())
-         {
-            std::string imagePath    = textures[i]["image"].get<std::string>();
-            std::string fullFileName = imagePath;
+//===========================================================================
+FME_UInt32 FMECityJSONReader::getTextureAppearance(int textureIndex)
+{
+   // Have we loaded this one already?
+   auto found = texturesMap_.find(textureIndex);
+   if (found != texturesMap_.end())
+   {
+      return found->second;
+   }
 
-            // We've got to make the full path, if it is relative.
-            // If it starts with "http" we know it's not relative.  If it can
-            // be found as a full path we'll also assume it is not relative.
-            if ((imagePath.rfind("http", 0) != 0) && (!std::filesystem::exists(fullFileName)))
-            {
-               // Fix up the relative pathname so we can find it.
-               // It is relative to the current dataset path.
-
-               // This is really gross code here.  Should be a separate method, etc.
-               // but I thought it would just be a good example starting point.
-               fullFileName = dataset_;
-               // TODO: I guess finding the directory the dataset is in may be tricky,
-               // and different on Windows and Linux, etc.   This is quick and dirty.
-               if (fullFileName.find_last_of("/") != std::string::npos)
-               {
-                  fullFileName.erase(fullFileName.find_last_of("/") + 1, std::string::npos);
-               }
-               if (fullFileName.find_last_of("\\") != std::string::npos)
-               {
-                  fullFileName.erase(fullFileName.find_last_of("\\") + 1, std::string::npos);
-               }
-               fullFileName += imagePath;
-            }
+   // Whatever happens below, we only try each texture once.
+   texturesMap_[textureIndex] = 0;
 
-            // Let's only read it in if we think we can see it.
-            if ((imagePath.rfind("http", 0) == 0) || std::filesystem::exists(fullFileName))
-            {
-               FME_Status badLuck = readRaster(fullFileName, raster, rasterType);
-               // if (badLuck) return badLuck;
-            }
-            else
-            {
-               // Let's not log too much.
-               std::string logKey = "missing texture";
-               if (limitLogging_[logKey]++ < 10)
-               {
-                  std::string message("CityJSON Reader: The texture file '");
-                  message += fullFileName;
-                  message += "' cannot be located.  Please ensure the file exists and is accessible.";
-                  gLogFile->logMessageString(message.c_str(), FME_WARN);
-               }
-            }
+   const json* textures(nullptr);
+   if (inputJSON_.contains("appearance") && inputJSON_["appearance"].contains("textures"))
+   {
+      textures = &inputJSON_["appearance"]["textures"];
+   }
+   if (!textures || textureIndex < 0 || textureIndex >= int(textures->size()))
+   {
+      return 0;
+   }
+   json texture = (*textures)[textureIndex];
 
-            // Set the "name".  We'll use that as the name of the appearance.
-            iName = std::filesystem::path(fullFileName).stem().string();
-         }
+   // Get the "type"
+   std::string rasterType;
+   if (not texture["type"].is_null())
+   {
+      std::string givenType = texture["type"].get<std::string>();
+      // These are the only expected types for now
+      if (givenType == "PNG")
+      {
+         rasterType = "PNGRASTER";
+      }
+      else if (givenType == "JPG")
+      {
+         rasterType = "JPEG";
+      }
+   }
+
+   // Get the "image"
+   IFMERaster* raster(nullptr);
+   std::string iName;
+   if (not texture["image"].is_null())
+   {
+      std::string imagePath    = texture["image"].get<std::string>();
+      std::string fullFileName = imagePath;
+
+      // We've got to make the full path, if it is relative.
+      // If it starts with "http" we know it's not relative.  If it can
+      // be found as a full path we'll also assume it is not relative.
+      if ((imagePath.rfind("http", 0) != 0) && (!std::filesystem::exists(fullFileName)))
+      {
+         // Fix up the relative pathname so we can find it.
+         // It is relative to the current dataset path.
 
-         // Set the Raster on the texture.
-         IFMETexture* tex = fmeGeometryTools_->createTexture();
-         if (raster)
+         // This is really gross code here.  Should be a separate method, etc.
+         // but I thought it would just be a good example starting point.
+         fullFileName = dataset_;
+         // TODO: I guess finding the directory the dataset is in may be tricky,
+         // and different on Windows and Linux, etc.   This is quick and dirty.
+         if (fullFileName.find_last_of("/") != std::string::npos)
          {
-            // Add the Raster to the FME Library
-            FME_UInt32 rasterRef(0);
-            FME_Status badLuck = gFMESession->getLibrary()->addRaster(rasterRef, raster);
-            if (badLuck) return badLuck;
-            raster = nullptr; // We no longer have ownership.
-            tex->setRasterReference(rasterRef);
+            fullFileName.erase(fullFileName.find_last_of("/") + 1, std::string::npos);
          }
-
-         // Set the "borderColor"
-         if (not textures[i]["borderColor"].is_null())
+         if (fullFileName.find_last_of("\\") != std::string::npos)
          {
-            // Note: Alpha is not used here.
-            tex->setBorderColor(textures[i]["borderColor"][0],
-                                textures[i]["borderColor"][1],
-                                textures[i]["borderColor"][2]);
+            fullFileName.erase(fullFileName.find_last_of("\\") + 1, std::string::npos);
          }
+         fullFileName += imagePath;
+      }
 
-         // Set the "wrapMode"
-         // Note that if you set the border colour after this, it will
-         // change the texture mode to FME_TEXTURE_BORDER_FILL.
-         if (not textures[i]["wrapMode"].is_null())
+      // Let's only read it in if we think we can see it.
+      if ((imagePath.rfind("http", 0) == 0) || std::filesystem::exists(fullFileName))
+      {
+         FME_Status badLuck = readRaster(fullFileName, raster, rasterType);
+         // if (badLuck) return 0;
+      }
+      else
+      {
+         // Let's not log too much.
+         std::string logKey = "missing texture";
+         if (limitLogging_[logKey]++ < 10)
          {
-            std::string wrapmode = textures[i]["wrapMode"].get<std::string>();
-            if (wrapmode == "none")
-            {
-               tex->setTextureWrap(FME_TEXTURE_NONE);
-            }
-            else if (wrapmode == "wrap")
-            {
-               tex->setTextureWrap(FME_TEXTURE_REPEAT_BOTH);
-            }
-            else if (wrapmode == "mirror")
-            {
-               tex->setTextureWrap(FME_TEXTURE_MIRROR);
-            }
-            else if (wrapmode == "clamp")
-            {
-               tex->setTextureWrap(FME_TEXTURE_CLAMP_BOTH);
-            }
-            else if (wrapmode == "border")
-            {
-               tex->setTextureWrap(FME_TEXTURE_BORDER_FILL);
-            }
+            std::string message("CityJSON Reader: The texture file '");
+            message += fullFileName;
+            message += "' cannot be located.  Please ensure the file exists and is accessible.";
+            gLogFile->logMessageString(message.c_str(), FME_WARN);
          }
+      }
 
-         // Set the "textureType"
-         // I'm not sure how best to represent this in FME.
-
-         // Add the Texture to the FME Library
-         FME_UInt32 textureRef(0);
-         FME_Status badLuck = gFMESession->getLibrary()->addTexture(textureRef, tex);
-         if (badLuck) return badLuck;
-         tex = nullptr; // We no longer have ownership.
-
-         // Set the texture on a new Appearance
-         IFMEAppearance* app = fmeGeometryTools_->createAppearance();
-         app->setTextureReference(textureRef);
+      // Set the "name".  We'll use that as the name of the appearance.
+      iName = std::filesystem::path(fullFileName).stem().string();
+   }
 
-         // Set the "name".
-         if (not iName.empty())
-         {
-            IFMEString* fmeVal = gFMESession->createString();
-            fmeVal->set(iName.c_str(), iName.length());
-            app->setName(*fmeVal, "fme-system");
-            gFMESession->destroyString(fmeVal);
-         }
+   // Set the Raster on the texture.
+   IFMETexture* tex = fmeGeometryTools_->createTexture();
+   if (raster)
+   {
+      // Add the Raster to the FME Library
+      FME_UInt32 rasterRef(0);
+      FME_Status badLuck = gFMESession->getLibrary()->addRaster(rasterRef, raster);
+      if (badLuck) return 0;
+      raster = nullptr; // We no longer have ownership.
+      tex->setRasterReference(rasterRef);
+   }
 
-         // Add the Appearance to the FME Library
-         FME_UInt32 appRef(0);
-         badLuck = gFMESession->getLibrary()->addAppearance(appRef, app);
-         if (badLuck) return badLuck;
-         app = nullptr; // We no longer have ownership.
+   // Set the "borderColor"
+   if (not texture["borderColor"].is_null())
+   {
+      // Note: Alpha is not used here.
+      tex->setBorderColor(texture["borderColor"][0],
+                          texture["borderColor"][1],
+                          texture["borderColor"][2]);
+   }
 
-         // Add the appearance (with texture) reference to the lookup table
-         texturesMap_.insert({i, appRef});
+   // Set the "wrapMode"
+   // Note that if you set the border colour after this, it will
+   // change the texture mode to FME_TEXTURE_BORDER_FILL.
+   if (not texture["wrapMode"].is_null())
+   {
+      std::string wrapmode = texture["wrapMode"].get<std::string>();
+      if (wrapmode == "none")
+      {
+         tex->setTextureWrap(FME_TEXTURE_NONE);
       }
-
-      // TODO: issue 71: What is the "default"?  (Not sure where to store this in FME yet.)
-      if (inputJSON_.at("appearance").contains("default-theme-texture"))
+      else if (wrapmode == "wrap")
       {
-         defaultThemeTexture_ =
-            inputJSON_.at("appearance").at("default-theme-texture").get<std::string>();
+         tex->setTextureWrap(FME_TEXTURE_REPEAT_BOTH);
+      }
+      else if (wrapmode == "mirror")
+      {
+         tex->setTextureWrap(FME_TEXTURE_MIRROR);
+      }
+      else if (wrapmode == "clamp")
+      {
+         tex->setTextureWrap(FME_TEXTURE_CLAMP_BOTH);
+      }
+      else if (wrapmode == "border")
+      {
+         tex->setTextureWrap(FME_TEXTURE_BORDER_FILL);
       }
    }
-   catch (json::out_of_range& e)
+
+   // Set the "textureType"
+   // I'm not sure how best to represent this in FME.
+
+   // Add the Texture to the FME Library
+   FME_UInt32 textureRef(0);
+   FME_Status badLuck = gFMESession->getLibrary()->addTexture(textureRef, tex);
+   if (badLuck) return 0;
+   tex = nullptr; // We no longer have ownership.
+
+   // Set the texture on a new Appearance
+   IFMEAppearance* app = fmeGeometryTools_->createAppearance();
+   app->setTextureReference(textureRef);
+
+   // Set the "name".
+   if (not iName.empty())
    {
-      gLogFile->logMessageString("The file does not contain any texture definitions.", FME_INFORM);
+      IFMEString* fmeVal = gFMESession->createString();
+      fmeVal->set(iName.c_str(), iName.length());
+      app->setName(*fmeVal, "fme-system");
+      gFMESession->destroyString(fmeVal);
    }
-   return FME_SUCCESS;
+
+   // Add the Appearance to the FME Library
+   FME_UInt32 appRef(0);
+   badLuck = gFMESession->getLibrary()->addAppearance(appRef, app);
+   if (badLuck) return 0;
+   app = nullptr; // We no longer have ownership.
+
+   // Add the appearance (with texture) reference to the lookup table
+   texturesMap_[textureIndex] = appRef;
+   return appRef;
 }
 
 //===========================================================================
@@ -759,11 +988,11 @@ FME_Status FMECityJSONReader::readGeometryDefinitions()
    // Reading the Geometry Templates and adding them to IFMELibrary as geometry instances
    try
    {
-      json templates         = inputJSON_.at("geometry-templates").at("templates");
-      json verticesTemplates = inputJSON_.at("geometry-templates").at("vertices-templates");
+      const json& templates         = inputJSON_.at("geometry-templates").at("templates");
+      const json& verticesTemplates = inputJSON_.at("geometry-templates").at("vertices-templates");
       VertexPool3D verticesTemplatesVec;
 
-      for (auto vtx : verticesTemplates)
+      for (const auto& vtx : verticesTemplates)
       {
          verticesTemplatesVec.emplace_back(vtx[0], vtx[1], vtx[2]);
       }
@@ -798,101 +1027,430 @@ FME_Status FMECityJSONReader::readGeometryDefinitions()
 }
 
 //===========================================================================
-void FMECityJSONReader::scanLODs()
+void FMECityJSONReader::indexCityObjects()
 {
-   // Need to go through the whole file to extract the LoD of each geometry
-   for (json::iterator it = inputJSON_.at("CityObjects").begin();
-        it != inputJSON_.at("CityObjects").end();
-        it++)
+   // Need to go through the whole file to extract the LoD of each geometry, and
+   // while we're there we'll remember everything else we need to know about each
+   // CityObject, so we never have to do this again.
+   objectIndex_.clear();
+   if (sequenceMode_)
    {
-      for (const auto& geometry : it.value().at("geometry"))
+      std::size_t position(sequenceStart_);
+      json feature;
+      while (readSequenceFeature(position, feature, nullptr))
       {
-         // These are maybe too many checks on the presence of an attribute. Ideally, the file would be
-         //      validated for the schema before it goes into FME, so we can omit these checks.
-         // Check which LoD is present in the data
-         std::string lod;
-         bool key_missing(false);
-         try
-         {
-            geometry.at("lod");
-            lod = lodToString(geometry);
-         }
-         catch (json::out_of_range& e)
-         {
-            try
-            {
-               int tId = geometry.at("template");
-               lod     = lodToString(inputJSON_.at("geometry-templates").at("templates")[tId]);
-            }
-            catch (json::out_of_range& e)
-            {
-               lod         = "";
-               key_missing = true;
-            }
-         }
-
-         if (not lod.empty())
+         for (auto it = feature.at("CityObjects").begin(); it != feature.at("CityObjects").end(); ++it)
          {
-            if (std::find(lodInData_.begin(), lodInData_.end(), lod) == lodInData_.end())
-            {
-               lodInData_.push_back(lod);
-            }
+            indexCityObject(it.key(), it.value());
          }
-         else if (not key_missing)
+      }
+   }
+   else if (streamCityObjects_)
+   {
+      for (const auto& span : cityObjectSpans_)
+      {
+         json cityObject;
+         if (readCityObjectSpan(span, cityObject))
          {
-            gLogFile->logMessageString(
-               ("The 'lod' attribute is empty in the geometry of the CityObject: " + it.key()).c_str(),
-               FME_WARN);
+            indexCityObject(decodeCityObjectId(span.id), cityObject);
          }
          else
          {
-            gLogFile->logMessageString(
-               ("Did not find the 'lod' attribute in the geometry of the CityObject: " + it.key()).c_str(),
-               FME_WARN);
+            // read() will skip it too, but we still need an entry for it.
+            FMECityJSONObjectIndex::Entry entry;
+            entry.alwaysRead = true;
+            objectIndex_.add(entry);
          }
       }
    }
-
-   if (lodInData_.size() > 1)
+   else
    {
-      std::stringstream lodMsg;
-      lodMsg << "There are multiple Levels of Detail present in the CityJSON data: ";
-      for (auto& l : lodInData_)
-         lodMsg << l << ", ";
-      std::string lodMsgStr = lodMsg.str();
-      lodMsgStr.erase(lodMsgStr.end() - 2);
-      gLogFile->logMessageString(lodMsgStr.c_str(), FME_INFORM);
-
-      if (lodParam_.empty())
+      for (json::iterator it = inputJSON_.at("CityObjects").begin();
+           it != inputJSON_.at("CityObjects").end();
+           it++)
       {
-         // The default LoD to read is the LoD of the first Geometry of the
-         // first CityObject.
-         std::string defaultMsg = "No value is set for the 'CityJSON Level of "
-                                  "Detail' parameter. Defaulting to: 'Highest'";
-         gLogFile->logMessageString(defaultMsg.c_str(), FME_WARN);
-         lodParam_ = "Highest";
+         indexCityObject(it.key(), it.value());
       }
-      else if (lodParam_ != "Highest")
-      {
-         // We may have some input like "1" and we need to match it to "1.0" successfully.
-         if (lodParam_.find_first_not_of("0123456789") == std::string::npos)
+   }
+}
+
+//===========================================================================
+void FMECityJSONReader::indexCityObjectBoxes()
+{
+   // One more pass over the CityObjects, for the box of each one, and who its
+   // parents and children are.  The ids are only needed to match those up.
+   readTemplateExtents();
+   std::vector<FMECityJSONBox> boxes;
+   boxes.reserve(objectIndex_.size());
+   std::unordered_map<std::string, std::size_t> objectIds;
+   std::vector<std::pair<std::string, std::string>> parentChildIds;
+   auto addRelatives = [&](std::size_t i, const std::string& objectId, const json& cityObject) {
+      objectIds.emplace(objectId, i);
+      for (const char* relation : {"children", "parents"})
+      {
+         auto related = cityObject.find(relation);
+         if (related == cityObject.end() or not related->is_array()) continue;
+         for (const auto& relatedId : *related)
          {
-            lodParam_ = lodParam_ + ".0";
+            if (not relatedId.is_string()) continue;
+            if (relation[0] == 'c')
+               parentChildIds.emplace_back(objectId, relatedId.get<std::string>());
+            else
+               parentChildIds.emplace_back(relatedId.get<std::string>(), objectId);
          }
+      }
+   };
 
-         if (std::find(lodInData_.begin(), lodInData_.end(), lodParam_) == lodInData_.end())
+   if (sequenceMode_)
+   {
+      std::size_t position(sequenceStart_);
+      json feature;
+      VertexPool3D lineVertices;
+      while (readSequenceFeature(position, feature, &lineVertices))
+      {
+         for (auto it = feature.at("CityObjects").begin(); it != feature.at("CityObjects").end(); ++it)
          {
-            std::string defaultMsg = "The provided 'CityJSON Level of Detail' parameter value " +
-                                     lodParam_ +
-                                     " is not present in the data. Defaulting to: 'Highest'";
-            gLogFile->logMessageString(defaultMsg.c_str(), FME_WARN);
-            lodParam_ = "Highest";
+            addRelatives(boxes.size(), it.key(), it.value());
+            boxes.push_back(cityObjectBox(it.value(), lineVertices));
          }
       }
    }
-   else if (lodInData_.size() == 1)
+   else if (streamCityObjects_)
    {
-      // In case there is only one LoD in the data, we ignore the Parameter
+      for (const auto& span : cityObjectSpans_)
+      {
+         json cityObject;
+         if (readCityObjectSpan(span, cityObject))
+         {
+            addRelatives(boxes.size(), decodeCityObjectId(span.id), cityObject);
+            boxes.push_back(cityObjectBox(cityObject, vertices_));
+         }
+         else
+         {
+            boxes.emplace_back();
+         }
+      }
+   }
+   else
+   {
+      // Everything is in memory already, so we can work out the boxes in parallel.
+      std::vector<const json*> cityObjects;
+      cityObjects.reserve(objectIndex_.size());
+      for (auto it = inputJSON_.at("CityObjects").begin(); it != inputJSON_.at("CityObjects").end(); ++it)
+      {
+         addRelatives(cityObjects.size(), it.key(), it.value());
+         cityObjects.push_back(&it.value());
+      }
+      boxes.resize(cityObjects.size());
+      forEachChunk(cityObjects.size(), [&](std::size_t begin, std::size_t end) {
+         for (std::size_t i = begin; i < end; ++i)
+         {
+            boxes[i] = cityObjectBox(*cityObjects[i], vertices_);
+         }
+      });
+   }
+
+   // This should never happen, but let's not read past the end of the boxes if it does.
+   boxes.resize(objectIndex_.size());
+   objectIndex_.setBoxes(std::move(boxes));
+
+   // Relatives that aren't in the file (or that we aren't reading) are left out.
+   std::vector<std::pair<std::size_t, std::size_t>> parentChild;
+   parentChild.reserve(parentChildIds.size());
+   for (const auto& [parentId, childId] : parentChildIds)
+   {
+      auto parent = objectIds.find(parentId);
+      auto child  = objectIds.find(childId);
+      if (parent != objectIds.end() and child != objectIds.end())
+      {
+         parentChild.emplace_back(parent->second, child->second);
+      }
+   }
+   objectIndex_.setRelations(std::move(parentChild));
+}
+
+//===========================================================================
+void FMECityJSONReader::buildSpatialIndex()
+{
+   if (spatialIndexBuilt_)
+   {
+      return;
+   }
+   if (not objectIndex_.hasBoxes())
+   {
+      indexCityObjectBoxes();
+   }
+
+   spatialIndex_.build(objectIndex_.boxes());
+   objectsWithoutBox_.clear();
+   for (std::size_t i = 0; i < objectIndex_.size(); ++i)
+   {
+      if (objectIndex_.box(i).empty())
+      {
+         objectsWithoutBox_.push_back(i);
+      }
+   }
+   spatialIndexBuilt_ = true;
+}
+
+//===========================================================================
+json FMECityJSONReader::indexCacheKey() const
+{
+   // If any of these change, the cache is no good.
+   std::error_code error;
+   const auto modified = std::filesystem::last_write_time(dataset_, error);
+
+   // The order of the CityObjects, and so the index, depends on how we read them.
+   std::string mode = sequenceMode_ ? "sequence" : (streamCityObjects_ ? "stream" : "document");
+
+   // The sampled hash only reads a few MB of the file, but can miss an edit that
+   // keeps the size and the modified time.  Hashing it all means reading the
+   // whole file one more time, which is less than the parse we're saving, but
+   // not by much.  So it's up to the user.
+   const std::uint64_t contentHash = indexCacheFullHash_
+                                        ? hashFileContents(inputFile_.begin(), inputFile_.size())
+                                        : hashFileSample(inputFile_.begin(), inputFile_.size());
+
+   return {{"version", 3},
+           {"fileSize", inputFile_.size()},
+           {"modified", error ? 0 : std::int64_t(modified.time_since_epoch().count())},
+           {"hash", indexCacheFullHash_ ? "full" : "sample"},
+           {"contentHash", contentHash},
+           {"mode", mode}};
+}
+
+//===========================================================================
+bool FMECityJSONReader::loadIndexCache(const json& key)
+{
+   const std::string cacheFileName = dataset_ + ".cjidx";
+   std::ifstream cacheFile(cacheFileName, std::ios::binary);
+   if (not cacheFile)
+   {
+      return false;
+   }
+   std::vector<std::uint8_t> bytes((std::istreambuf_iterator<char>(cacheFile)),
+                                   std::istreambuf_iterator<char>());
+
+   // Anything wrong with it, and we just build the index again.
+   json cache = json::from_cbor(bytes, true, false);
+   if (cache.is_discarded() or not cache.is_object() or cache.value("key", json()) != key)
+   {
+      gLogFile->logMessageString(("The CityObject index cache '" + cacheFileName +
+                                  "' is out of date, building it again.")
+                                    .c_str(),
+                                 FME_INFORM);
+      return false;
+   }
+
+   try
+   {
+      // When streaming, the index lines up with the CityObject spans, so they had
+      // better be the same.  In the other modes there are no spans, so both are
+      // empty, and the "mode" in the key already makes sure we read them the same way.
+      const json& objects = cache.at("objects");
+      bool sameObjects    = (objects.size() == 2 * cityObjectSpans_.size());
+      for (std::size_t i = 0; sameObjects and i < cityObjectSpans_.size(); ++i)
+      {
+         sameObjects = (objects[2 * i].get<std::size_t>() == cityObjectSpans_[i].offset) and
+                       (objects[2 * i + 1].get<std::size_t>() == cityObjectSpans_[i].length);
+      }
+      if (not sameObjects or not objectIndex_.fromJSON(cache.at("index")))
+      {
+         objectIndex_.clear();
+         return false;
+      }
+      lodInData_ = cache.at("lods").get<std::vector<std::string>>();
+   }
+   catch (json::exception&)
+   {
+      objectIndex_.clear();
+      return false;
+   }
+
+   gLogFile->logMessageString(("Using the CityObject index cache '" + cacheFileName + "'.").c_str(),
+                              FME_INFORM);
+   return true;
+}
+
+//===========================================================================
+void FMECityJSONReader::saveIndexCache(const json& key) const
+{
+   // Where each CityObject is in the file.  We only know that when streaming.
+   json objects = json::array();
+   for (const auto& span : cityObjectSpans_)
+   {
+      objects.push_back(span.offset);
+      objects.push_back(span.length);
+   }
+
+   json cache = {{"key", key},
+                 {"lods", lodInData_},
+                 {"index", objectIndex_.toJSON()},
+                 {"objects", std::move(objects)}};
+   const std::vector<std::uint8_t> bytes = json::to_cbor(cache);
+
+   // Write it beside the cache and move it into place, so nobody ever sees half a cache.
+   const std::string cacheFileName = dataset_ + ".cjidx";
+   const std::string tempFileName  = cacheFileName + ".tmp";
+   {
+      std::ofstream cacheFile(tempFileName, std::ios::binary | std::ios::trunc);
+      cacheFile.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+      if (not cacheFile)
+      {
+         cacheFile.close();
+         std::error_code error;
+         std::filesystem::remove(tempFileName, error);
+         gLogFile->logMessageString(("Unable to write the CityObject index cache '" +
+                                     cacheFileName + "'.")
+                                       .c_str(),
+                                    FME_WARN);
+         return;
+      }
+   }
+   std::error_code error;
+   std::filesystem::rename(tempFileName, cacheFileName, error);
+   if (error)
+   {
+      std::filesystem::remove(tempFileName, error);
+      gLogFile->logMessageString(("Unable to write the CityObject index cache '" + cacheFileName +
+                                  "'.")
+                                    .c_str(),
+                                 FME_WARN);
+   }
+}
+
+//===========================================================================
+void FMECityJSONReader::indexCityObject(const std::string& objectId, const json& cityObject)
+{
+   scanCityObjectLODs(objectId, cityObject);
+
+   FMECityJSONObjectIndex::Entry entry;
+   const json& geometries = cityObject.at("geometry");
+
+   // Let's find out what we will be using as the "feature_type", and
+   // group the schema by that.  I'll pick the field "type".
+   auto type = cityObject.find("type");
+   if (type != cityObject.end() and type->is_string())
+   {
+      entry.typeId = objectIndex_.typeId(type->get<std::string>());
+   }
+
+   // CityObjects with empty geometries are always read
+   if (geometries.empty()) entry.alwaysRead = true;
+
+   // When reading the 'Highest' LOD, we use the highest of the numeric LODs
+   // of this CityObject.  Anything else counts as "", which is lower than all of them.
+   std::string highestLod;
+   for (const auto& geometry : geometries)
+   {
+      if (not geometry.is_object())
+      {
+         entry.alwaysRead = true;
+         continue;
+      }
+
+      const std::string geometryLodValue = lodToString(geometry);
+
+      // Only ignore the feature if it is certain that the
+      // required LoD (parmeter) != the LoD in the data.
+      // All other cases (null, missing etc.) should be read.
+      if (geometryLodValue.empty())
+      {
+         entry.alwaysRead = true;
+         continue;
+      }
+
+      const std::int32_t lodId = objectIndex_.lodId(geometryLodValue);
+      if (std::size_t(lodId) < FMECityJSONObjectIndex::kMaxMaskedLods)
+      {
+         entry.lodMask |= std::uint64_t(1) << lodId;
+      }
+      else
+      {
+         entry.lodMaskIncomplete = true;
+      }
+
+      // We don't really want to use this number, but we want to know if it *is* a number.
+      char* numberEnd(nullptr);
+      std::strtod(geometryLodValue.c_str(), &numberEnd);
+      if (numberEnd != geometryLodValue.c_str() and geometryLodValue > highestLod)
+      {
+         highestLod      = geometryLodValue;
+         entry.highestLod = lodId;
+      }
+   }
+   objectIndex_.add(entry);
+
+   if (entry.typeId >= 0)
+   {
+      addCityObjectToSchema(cityObject, objectIndex_.featureType(objectIndex_.typeName(entry.typeId)));
+   }
+}
+
+//===========================================================================
+void FMECityJSONReader::scanLODs()
+{
+   // There's no point caching the index of a few CityObjects.
+   const bool useIndexCache = useIndexCache_ and idsToRead_.empty();
+   const json cacheKey      = useIndexCache ? indexCacheKey() : json();
+   const bool fromCache     = useIndexCache and loadIndexCache(cacheKey);
+   if (not fromCache)
+   {
+      indexCityObjects();
+   }
+
+   // A search envelope needs the boxes too.  They may be in the cache already.
+   const bool addBoxes = not searchEnvelope_.empty() and not objectIndex_.hasBoxes();
+   if (addBoxes)
+   {
+      indexCityObjectBoxes();
+   }
+
+   if (useIndexCache and (not fromCache or addBoxes))
+   {
+      saveIndexCache(cacheKey);
+   }
+
+   if (lodInData_.size() > 1)
+   {
+      std::stringstream lodMsg;
+      lodMsg << "There are multiple Levels of Detail present in the CityJSON data: ";
+      for (auto& l : lodInData_)
+         lodMsg << l << ", ";
+      std::string lodMsgStr = lodMsg.str();
+      lodMsgStr.erase(lodMsgStr.end() - 2);
+      gLogFile->logMessageString(lodMsgStr.c_str(), FME_INFORM);
+
+      if (lodParam_.empty())
+      {
+         // The default LoD to read is the LoD of the first Geometry of the
+         // first CityObject.
+         std::string defaultMsg = "No value is set for the 'CityJSON Level of "
+                                  "Detail' parameter. Defaulting to: 'Highest'";
+         gLogFile->logMessageString(defaultMsg.c_str(), FME_WARN);
+         lodParam_ = "Highest";
+      }
+      else if (lodParam_ != "Highest")
+      {
+         // We may have some input like "1" and we need to match it to "1.0" successfully.
+         if (lodParam_.find_first_not_of("0123456789") == std::string::npos)
+         {
+            lodParam_ = lodParam_ + ".0";
+         }
+
+         if (std::find(lodInData_.begin(), lodInData_.end(), lodParam_) == lodInData_.end())
+         {
+            std::string defaultMsg = "The provided 'CityJSON Level of Detail' parameter value " +
+                                     lodParam_ +
+                                     " is not present in the data. Defaulting to: 'Highest'";
+            gLogFile->logMessageString(defaultMsg.c_str(), FME_WARN);
+            lodParam_ = "Highest";
+         }
+      }
+   }
+   else if (lodInData_.size() == 1)
+   {
+      // In case there is only one LoD in the data, we ignore the Parameter
       // even if it is set.
       if (lodParam_ != "Highest")
       {
@@ -921,45 +1479,125 @@ void FMECityJSONReader::scanLODs()
    {
       gLogFile->logMessageString("Reading the 'Highest' Level of Detail for every geometry in this file.", FME_INFORM);
    }
+
+   lodParamId_ = objectIndex_.findLod(lodParam_);
+}
+
+//===========================================================================
+void FMECityJSONReader::scanCityObjectLODs(const std::string& objectId, const json& cityObject)
+{
+   for (const auto& geometry : cityObject.at("geometry"))
+   {
+      // These are maybe too many checks on the presence of an attribute. Ideally, the file would be
+      //      validated for the schema before it goes into FME, so we can omit these checks.
+      // Check which LoD is present in the data
+      std::string lod;
+      bool key_missing(false);
+      try
+      {
+         geometry.at("lod");
+         lod = lodToString(geometry);
+      }
+      catch (json::out_of_range& e)
+      {
+         try
+         {
+            int tId = geometry.at("template");
+            lod     = lodToString(inputJSON_.at("geometry-templates").at("templates").at(tId));
+         }
+         catch (json::out_of_range& e)
+         {
+            lod         = "";
+            key_missing = true;
+         }
+      }
+
+      if (not lod.empty())
+      {
+         if (std::find(lodInData_.begin(), lodInData_.end(), lod) == lodInData_.end())
+         {
+            lodInData_.push_back(lod);
+         }
+      }
+      else if (not key_missing)
+      {
+         gLogFile->logMessageString(
+            ("The 'lod' attribute is empty in the geometry of the CityObject: " + objectId).c_str(),
+            FME_WARN);
+      }
+      else
+      {
+         gLogFile->logMessageString(
+            ("Did not find the 'lod' attribute in the geometry of the CityObject: " + objectId).c_str(),
+            FME_WARN);
+      }
+   }
+}
+
+namespace
+{
+   //===========================================================================
+   // One of the "scale" or "translate" arrays of the "transform".  Returns false
+   // unless it is there, and is exactly 3 numbers.
+   bool readTransformArray(const json& transformObject, const char* name, std::vector<double>& values)
+   {
+      if (not transformObject.is_object())
+      {
+         return false;
+      }
+      auto found = transformObject.find(name);
+      if (found == transformObject.end() or not found->is_array() or found->size() != 3)
+      {
+         return false;
+      }
+      values.clear();
+      for (const auto& v : *found)
+      {
+         if (not v.is_number())
+         {
+            return false;
+         }
+         values.push_back(v.get<double>());
+      }
+      return true;
+   }
 }
 
 //===========================================================================
-void FMECityJSONReader::readVertexPool()
+FME_Status FMECityJSONReader::readVertexPool()
 {
-   // Transform object
+   // Transform object.  Whether the header came from parsing the whole file, the
+   // stream scanner, or the first line of a sequence, this is where we read it.
    std::vector<double> scale{1.0, 1.0, 1.0};
    std::vector<double> translation{0.0, 0.0, 0.0};
-   try
+   auto transformObject = inputJSON_.find("transform");
+   if (transformObject != inputJSON_.end())
    {
-      json transformObject = inputJSON_.at("transform");
       gLogFile->logMessageString("Reading compressed CityJSON file.", FME_INFORM);
-      scale.clear();
-      for (double const s : transformObject.at("scale"))
-      {
-         scale.push_back(s);
-      }
-      translation.clear();
-      for (double const t : transformObject.at("translate"))
+      if (not readTransformArray(*transformObject, "scale", scale) or
+          not readTransformArray(*transformObject, "translate", translation))
       {
-         translation.push_back(t);
+         gLogFile->logMessageString(kMsgBadTransform, FME_ERROR);
+         return FME_FAILURE;
       }
    }
-   catch (json::out_of_range& e)
+   else
    {
       gLogFile->logMessageString("Reading uncompressed CityJSON file.", FME_INFORM);
    }
+   transformScale_       = scale;
+   transformTranslation_ = translation;
 
    // Vertices
-   for (auto vtx : inputJSON_.at("vertices"))
-   {
-      double x = vtx[0];
-      double y = vtx[1];
-      double z = vtx[2];
-      x        = scale[0] * x + translation[0];
-      y        = scale[1] * y + translation[1];
-      z        = scale[2] * z + translation[2];
-      vertices_.emplace_back(x, y, z);
-   }
+   // The parser has already filled the pool, they just need to be transformed.
+   transformVertices(vertices_);
+   return FME_SUCCESS;
+}
+
+//===========================================================================
+void FMECityJSONReader::transformVertices(VertexPool3D& vertices) const
+{
+   vertices.transform(transformScale_, transformTranslation_);
 }
 
 //===========================================================================
@@ -988,9 +1626,26 @@ FME_Status FMECityJSONReader::close()
       gFMESession->destroyFeature(sf.second);
    }
    schemaFeatures_.clear();
+   objectIndex_.clear();
+   templateExtents_.clear();
+   inSearchEnvelope_.clear();
+   spatialIndex_.clear();
+   objectsWithoutBox_.clear();
+   spatialIndexBuilt_ = false;
 
-   // shut the file
+   for (auto& [key, value] : rasterReaders_)
+   {
+      gFMESession->destroyReader(value);
+   }
+   rasterReaders_.clear();
+
+   // shut the file, the spans point into it so they go first
+   cityObjectSpans_.clear();
+   currentCityObject_ = json();
+   currentFeature_    = json();
+   featureVertices_.clear();
    inputFile_.close();
+   parser_.reset();
 
    gFMESession->destroyString(textureCoordUName_);
    textureCoordUName_ = nullptr;
@@ -1002,6 +1657,12 @@ FME_Status FMECityJSONReader::close()
    gLogFile->logMessageString(("Skipped reading " + std::to_string(skippedObjects_) +
                                " features due to 'CityJSON Level of Detail' parameter setting")
                                  .c_str());
+   if (not searchEnvelope_.empty())
+   {
+      gLogFile->logMessageString(("Skipped reading " + std::to_string(skippedOutsideEnvelope_) +
+                                  " features outside the search envelope")
+                                    .c_str());
+   }
 
    return FME_SUCCESS;
 }
@@ -1017,12 +1678,6 @@ FME_Status FMECityJSONReader::read(IFMEFeature& feature, FME_Boolean& endOfFile)
    // Set the coordinate system
    feature.setCoordSys(coordSys_.c_str());
 
-   if (nextObject_ == inputJSON_.at("CityObjects").end() and metaObject_.empty())
-   {
-      endOfFile = FME_TRUE;
-      return FME_SUCCESS;
-   }
-
    if (not metaObject_.empty())
    {
       // reading the metadata into a feature
@@ -1037,63 +1692,58 @@ FME_Status FMECityJSONReader::read(IFMEFeature& feature, FME_Boolean& endOfFile)
    }
    else
    {
-      // Skipping CityObjects completely if it has no geometries of the chosen LOD.
-      if (lodParam_ != "Highest") // We know we will never skip a geometry in "Highest" mode
+      // Find the next CityObject to read.
+      std::string objectId;
+      json* nextCityObject(nullptr);
+      VertexPool3D* vertices(nullptr);
+      std::size_t objectIndex(0);
+      while (true)
       {
-         std::vector<bool> ignore_lod;
-         std::string geometryLodValue;
+         if (not fetchNextCityObject(objectId, nextCityObject, vertices, objectIndex))
+         {
+            endOfFile = FME_TRUE;
+            return FME_SUCCESS;
+         }
 
-         // CityObjects with empty geometries are always read
-         if (nextObject_.value()["geometry"].empty()) ignore_lod.push_back(false);
+         // A CityJSON Text Sequence still has to be read line by line.
+         if (not idsToRead_.empty() and idsToRead_.count(objectId) == 0)
+         {
+            continue;
+         }
 
-         for (auto& geometry : nextObject_.value()["geometry"])
+         // We already know about the type and the search envelope, before we parse any geometry.
+         if (not wantCityObject(objectIndex))
          {
-            // Check if the whole feature should be ignored
-            if (geometry.is_object())
-            {
-               geometryLodValue = lodToString(geometry);
-               // Only ignore the feature if it is certain that the
-               // required LoD (parmeter) != the LoD in the data.
-               // All other cases (null, missing etc.) should be read.
-               ignore_lod.push_back(not geometryLodValue.empty() and geometryLodValue != lodParam_);
-            }
-            else
-               ignore_lod.push_back(false);
+            continue;
          }
 
-         if (std::all_of(ignore_lod.begin(), ignore_lod.end(), [](bool i) { return i; }))
+         // Skipping CityObjects completely if it has no geometries of the chosen LOD.
+         if (not skipCityObjectForLOD(objectIndex_.entry(objectIndex), *nextCityObject))
          {
-            // We skip this object, because none of its geometries have the required LoD
-            ++nextObject_;
-            skippedObjects_++;
-            endOfFile = FME_FALSE;
-            return read(feature, endOfFile);
+            break;
          }
+
+         // We skip this object, because none of its geometries have the required LoD
+         skippedObjects_++;
       }
+      json& cityObject = *nextCityObject;
 
       // reading CityObjects into features
-      std::string objectId = nextObject_.key();
 
       // Set the feature type
-      std::string featureType = nextObject_.value().at("type").get<std::string>();
+      std::string featureType = cityObject.at("type").get<std::string>();
       feature.setFeatureType(featureType.c_str());
 
       // Set feature attributes
       feature.setAttribute("fid", objectId.c_str());
 
-      json attributes;
-      try
-      {
-         attributes = nextObject_.value().at("attributes");
-      }
-      catch (json::out_of_range& e)
-      {
-      }
-      if (not attributes.empty())
+      auto attributes = cityObject.find("attributes");
+      if (attributes != cityObject.end() and attributes->is_object())
       {
-         json::iterator attrIt          = attributes.begin();
-         const json::iterator attrItEnd = attributes.end();
-         parseAttributes(feature, attrIt, attrItEnd);
+         json::iterator attrIt          = attributes->begin();
+         const json::iterator attrItEnd = attributes->end();
+         parseAttributes(
+            feature, attrIt, attrItEnd, attributesToRead_.empty() ? nullptr : &attributesToRead_);
       }
       // Set child and parent CityObjects as attributes. In FME we don't have/set an explicit object
       // hierarchy, but each feature is on the same level. Therefore we store the child-parent
@@ -1101,64 +1751,37 @@ FME_Status FMECityJSONReader::read(IFMEFeature& feature, FME_Boolean& endOfFile)
       // cityjson. I'm not adding the children and parents attributes to the schema, because its
       // better if they are hidden from the table view, since there can be many-many children for
       // each feature.
-      if (not nextObject_.value()["children"].is_null() && not nextObject_.value()["children"].empty())
+      const json& childIds = member(cityObject, "children");
+      if (not childIds.is_null() && not childIds.empty())
       {
          IFMEStringArray* children = gFMESession->createStringArray();
-         for (std::string child : nextObject_.value()["children"])
+         for (const auto& child : childIds)
          {
-            children->append(child.c_str());
+            children->append(child.get_ref<const std::string&>().c_str());
          }
          feature.setListAttributeNonSequenced("cityjson_children", *children);
          gFMESession->destroyStringArray(children);
       }
 
-      if (not nextObject_.value()["parents"].is_null() && not nextObject_.value()["parents"].empty())
+      const json& parentIds = member(cityObject, "parents");
+      if (not parentIds.is_null() && not parentIds.empty())
       {
          IFMEStringArray* parents = gFMESession->createStringArray();
-         for (std::string parent : nextObject_.value()["parents"])
+         for (const auto& parent : parentIds)
          {
-            parents->append(parent.c_str());
+            parents->append(parent.get_ref<const std::string&>().c_str());
          }
          feature.setListAttributeNonSequenced("cityjson_parents", *parents);
          gFMESession->destroyStringArray(parents);
       }
 
-      // Let's do a bit of work here, if we're asked to read the 'Highest" LOD
+      // If we're asked to read the 'Highest" LOD, we found out which one that is
+      // for this CityObject when we opened the file.
       std::string LODToUse(lodParam_);
       if (lodParam_ == "Highest")
       {
-         LODToUse = "";
-         // Build up a clean list of the LODs we have for this geometry
-         std::vector<std::string > allLODs;
-         for (auto& geometry : nextObject_.value()["geometry"])
-         {
-            if (geometry.is_object())
-            {
-               std::string geometryLodValue = lodToString(geometry);
-               try
-               {
-                  // We don't really want to use this number, but we
-                  // want to know if it *is* a number, by catching the error
-                  double lodAsDouble = std::stod(geometryLodValue);
-                  allLODs.push_back(geometryLodValue);
-               }
-               catch (const std::invalid_argument&)
-               {
-                  allLODs.push_back("");
-               }
-            }
-            else // I don't think this case can happen.
-            {
-               allLODs.push_back("");
-            }
-         }
-
-         // sort, and pick the "Highest" one.  It will be the last.
-         if (!allLODs.empty())
-         {
-            std::sort(allLODs.begin(), allLODs.end());
-            LODToUse = allLODs.back();
-         }
+         const std::int32_t highestLod = objectIndex_.entry(objectIndex).highestLod;
+         LODToUse = (highestLod < 0) ? "" : objectIndex_.lodName(highestLod);
       }
 
       // Set the geometry
@@ -1167,10 +1790,10 @@ FME_Status FMECityJSONReader::read(IFMEFeature& feature, FME_Boolean& endOfFile)
       // LOD. If we get more than one geometry at a requested LOD, we will
       // output an aggregate geometry.
       IFMEAggregate* aggregate = fmeGeometryTools_->createAggregate();
-      for (auto& geometry : nextObject_.value()["geometry"])
+      for (const auto& geometry : member(cityObject, "geometry"))
       {
          // Set the geometry for the feature
-         IFMEGeometry* geom = parseCityObjectGeometry(geometry, vertices_, LODToUse, false);
+         IFMEGeometry* geom = parseCityObjectGeometry(geometry, *vertices, LODToUse, false);
          if (geom != nullptr)
          {
             aggregate->appendPart(geom);
@@ -1178,37 +1801,680 @@ FME_Status FMECityJSONReader::read(IFMEFeature& feature, FME_Boolean& endOfFile)
          // else if we get nullptr, that means it was an LOD we want to skip.
       }
 
-      if (aggregate->numParts() == 0)
+      if (aggregate->numParts() == 0)
+      {
+         fmeGeometryTools_->destroyGeometry(aggregate);
+         aggregate = nullptr;
+      }
+      else if (aggregate->numParts() == 1)
+      {
+         feature.setGeometry(aggregate->removeLastPart());
+         fmeGeometryTools_->destroyGeometry(aggregate);
+         aggregate = nullptr;
+      }
+      else
+      {
+         feature.setGeometry(aggregate);
+         aggregate = nullptr;
+      }
+
+      endOfFile = FME_FALSE;
+      return FME_SUCCESS;
+   }
+}
+
+//===========================================================================
+bool FMECityJSONReader::skipCityObjectForLOD(const FMECityJSONObjectIndex::Entry& entry,
+                                             json& cityObject)
+{
+   if (lodParam_ == "Highest") // We know we will never skip a geometry in "Highest" mode
+   {
+      return false;
+   }
+
+   // The index has the answer, unless the file has a silly number of different LoDs.
+   if (not entry.lodMaskIncomplete)
+   {
+      const bool hasLod = (lodParamId_ >= 0) and
+                          (std::size_t(lodParamId_) < FMECityJSONObjectIndex::kMaxMaskedLods) and
+                          (entry.lodMask & (std::uint64_t(1) << lodParamId_));
+      return not entry.alwaysRead and not hasLod;
+   }
+
+   std::vector<bool> ignore_lod;
+   std::string geometryLodValue;
+
+   // CityObjects with empty geometries are always read
+   const json& geometries = member(cityObject, "geometry");
+   if (geometries.empty()) ignore_lod.push_back(false);
+
+   for (const auto& geometry : geometries)
+   {
+      // Check if the whole feature should be ignored
+      if (geometry.is_object())
+      {
+         geometryLodValue = lodToString(geometry);
+         // Only ignore the feature if it is certain that the
+         // required LoD (parmeter) != the LoD in the data.
+         // All other cases (null, missing etc.) should be read.
+         ignore_lod.push_back(not geometryLodValue.empty() and geometryLodValue != lodParam_);
+      }
+      else
+         ignore_lod.push_back(false);
+   }
+
+   return std::all_of(ignore_lod.begin(), ignore_lod.end(), [](bool i) { return i; });
+}
+
+//===========================================================================
+bool FMECityJSONReader::wantCityObject(std::size_t objectIndex)
+{
+   if (not readType_.empty())
+   {
+      const std::int32_t typeId = objectIndex_.entry(objectIndex).typeId;
+      if (typeId < 0 or not readType_[typeId])
+      {
+         return false;
+      }
+   }
+
+   if (not inSearchEnvelope_.empty() and not inSearchEnvelope_[objectIndex])
+   {
+      skippedOutsideEnvelope_++;
+      return false;
+   }
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONReader::fetchNextCityObject(std::string& objectId,
+                                            json*& cityObject,
+                                            VertexPool3D*& vertices,
+                                            std::size_t& objectIndex)
+{
+   if (sequenceMode_)
+   {
+      // Each line may have several CityObjects (a parent and its children), which
+      // all use the vertices of that line.
+      while (currentFeature_.is_null() or nextFeatureObject_ == currentFeature_.at("CityObjects").end())
+      {
+         if (not readSequenceFeature(nextLinePosition_, currentFeature_, &featureVertices_))
+         {
+            currentFeature_ = json();
+            return false;
+         }
+         nextFeatureObject_ = currentFeature_.at("CityObjects").begin();
+      }
+      objectId    = nextFeatureObject_.key();
+      cityObject  = &nextFeatureObject_.value();
+      vertices    = &featureVertices_;
+      objectIndex = nextObjectIndex_++;
+      ++nextFeatureObject_;
+      return true;
+   }
+
+   vertices = &vertices_;
+   if (streamCityObjects_)
+   {
+      // The previous CityObject is released as soon as we parse the next one.
+      while (nextSpan_ < cityObjectSpans_.size())
+      {
+         objectIndex                = nextSpan_;
+         const CityObjectSpan& span = cityObjectSpans_[nextSpan_++];
+
+         // Don't even parse the ones we aren't going to read.
+         if (not wantCityObject(objectIndex))
+         {
+            continue;
+         }
+
+         if (readCityObjectSpan(span, currentCityObject_))
+         {
+            objectId   = decodeCityObjectId(span.id);
+            cityObject = &currentCityObject_;
+            return true;
+         }
+      }
+      currentCityObject_ = json();
+      return false;
+   }
+
+   if (nextObject_ == inputJSON_.at("CityObjects").end())
+   {
+      return false;
+   }
+   objectId    = nextObject_.key();
+   cityObject  = &nextObject_.value();
+   objectIndex = nextObjectIndex_++;
+   ++nextObject_;
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONReader::readCityObjectSpan(const CityObjectSpan& span, json& cityObject)
+{
+   std::string errorMessage;
+   if (not parser_->parseValue(inputFile_, span.offset, span.length, cityObject, errorMessage))
+   {
+      gLogFile->logMessageString(("Unable to parse the CityObject '" + decodeCityObjectId(span.id) +
+                                  "': " + errorMessage)
+                                    .c_str(),
+                                 FME_ERROR);
+      return false;
+   }
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONReader::nextSequenceLine(std::size_t& position,
+                                         std::size_t& lineStart,
+                                         std::size_t& lineLength) const
+{
+   const char* data       = inputFile_.begin();
+   const std::size_t size = inputFile_.size();
+   while (position < size)
+   {
+      const char* newline =
+         static_cast<const char*>(std::memchr(data + position, '\n', size - position));
+      const std::size_t lineEnd = (newline == nullptr) ? size : newline - data;
+
+      lineStart  = position;
+      lineLength = lineEnd - position;
+      position   = (newline == nullptr) ? size : lineEnd + 1;
+
+      // Blank lines are allowed, we just skip them.
+      if (std::string_view(data + lineStart, lineLength).find_first_not_of(" \t\r") !=
+          std::string_view::npos)
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+//===========================================================================
+FME_Status FMECityJSONReader::readSequenceHeader()
+{
+   gLogFile->logMessageString("Reading a CityJSON Text Sequence.", FME_INFORM);
+   inputFile_.adviseSequential();
+
+   // The first line is a CityJSON object with everything except the CityObjects.
+   std::size_t position(0);
+   std::size_t lineStart(0);
+   std::size_t lineLength(0);
+   if (not nextSequenceLine(position, lineStart, lineLength))
+   {
+      gLogFile->logMessageString("The CityJSON Text Sequence is empty", FME_ERROR);
+      return FME_FAILURE;
+   }
+
+   std::string errorMessage;
+   if (not parser_->parseDocument(
+          inputFile_, lineStart, lineLength, inputJSON_, vertices_, errorMessage))
+   {
+      gLogFile->logMessageString(
+         ("Unable to parse the first line of the CityJSON Text Sequence: " + errorMessage).c_str(),
+         FME_ERROR);
+      return FME_FAILURE;
+   }
+
+   // The header should not have any, but let's make sure we have somewhere to point at.
+   if (inputJSON_.find("CityObjects") == inputJSON_.end())
+   {
+      inputJSON_["CityObjects"] = json::object();
+   }
+
+   sequenceStart_ = position;
+   return FME_SUCCESS;
+}
+
+//===========================================================================
+bool FMECityJSONReader::readSequenceFeature(std::size_t& position,
+                                            json& feature,
+                                            VertexPool3D* vertices)
+{
+   std::size_t lineStart(0);
+   std::size_t lineLength(0);
+   while (nextSequenceLine(position, lineStart, lineLength))
+   {
+      std::string errorMessage;
+      bool parsed(false);
+      if (vertices != nullptr)
+      {
+         // Each line has its own vertices, quantized with the transform from the header.
+         vertices->clear();
+         parsed = parser_->parseDocument(
+            inputFile_, lineStart, lineLength, feature, *vertices, errorMessage);
+         if (parsed) transformVertices(*vertices);
+
+         // We go through the lines more than once, so only say this the first time.
+         if (parsed and parser_->badVertices() > 0 and limitLogging_["featureBadVertices"]++ == 0)
+         {
+            gLogFile->logMessageString(("The CityJSONFeature at byte " + std::to_string(lineStart) +
+                                        " has " + std::to_string(parser_->badVertices()) +
+                                        " vertices that do not have exactly 3 coordinates.")
+                                          .c_str(),
+                                       FME_WARN);
+         }
+      }
+      else
+      {
+         parsed = parser_->parseValue(inputFile_, lineStart, lineLength, feature, errorMessage);
+      }
+
+      if (not parsed)
+      {
+         gLogFile->logMessageString(("Unable to parse the CityJSONFeature at byte " +
+                                     std::to_string(lineStart) + ": " + errorMessage)
+                                       .c_str(),
+                                    FME_ERROR);
+         continue;
+      }
+
+      if (not feature.is_object() or feature.value("type", "") != "CityJSONFeature" or
+          not feature["CityObjects"].is_object())
+      {
+         gLogFile->logMessageString(("Skipping the line at byte " + std::to_string(lineStart) +
+                                     ", it is not a CityJSONFeature.")
+                                       .c_str(),
+                                    FME_WARN);
+         continue;
+      }
+
+      if (feature.find("appearance") != feature.end() and limitLogging_["featureAppearance"]++ == 0)
+      {
+         gLogFile->logMessageString("Appearances inside a CityJSONFeature are not supported yet, "
+                                    "only the ones in the first line of the file are read.",
+                                    FME_WARN);
+      }
+      return true;
+   }
+   return false;
+}
+
+//===========================================================================
+FME_Status FMECityJSONReader::scanStream()
+{
+   // We make a single pass over the file, keeping everything except the CityObjects
+   // and the vertices as json.  For the CityObjects we only remember where they are,
+   // so we can come back and parse them one at a time.  This means it does not matter
+   // if the "vertices", "transform", "appearance" etc. come after the "CityObjects".
+   gLogFile->logMessageString("Streaming the CityObjects from the input file.", FME_INFORM);
+
+   inputFile_.adviseSequential();
+   std::string errorMessage;
+   if (not parser_->scanDocument(
+          inputFile_, 0, inputFile_.size(), inputJSON_, vertices_, cityObjectSpans_, errorMessage))
+   {
+      gLogFile->logMessageString(("Unable to parse the input file: " + errorMessage).c_str(),
+                                 FME_ERROR);
+      return FME_FAILURE;
+   }
+
+   logBadVertices(parser_->badVertices());
+
+   return FME_SUCCESS;
+}
+
+namespace
+{
+   //===========================================================================
+   // All the vertex indices in the "boundaries" of a geometry.
+   void collectVertexIndices(const json& boundaries, std::vector<std::size_t>& indices)
+   {
+      if (boundaries.is_array())
+      {
+         for (const auto& b : boundaries)
+         {
+            collectVertexIndices(b, indices);
+         }
+      }
+      else if (boundaries.is_number_integer() and boundaries.get<std::int64_t>() >= 0)
+      {
+         indices.push_back(boundaries.get<std::size_t>());
+      }
+   }
+
+   //===========================================================================
+   // Change the vertex indices in the "boundaries" of a geometry to where they
+   // are in the sorted list of indices we kept.
+   void remapVertexIndices(json& boundaries, const std::vector<std::size_t>& indices)
+   {
+      if (boundaries.is_array())
+      {
+         for (auto& b : boundaries)
+         {
+            remapVertexIndices(b, indices);
+         }
+      }
+      else if (boundaries.is_number_integer() and boundaries.get<std::int64_t>() >= 0)
+      {
+         auto found = std::lower_bound(indices.begin(), indices.end(), boundaries.get<std::size_t>());
+         boundaries = std::size_t(found - indices.begin());
+      }
+   }
+}
+
+//===========================================================================
+void FMECityJSONReader::logBadVertices(std::size_t badVertices)
+{
+   if (badVertices > 0)
+   {
+      gLogFile->logMessageString((std::to_string(badVertices) +
+                                  " vertices do not have exactly 3 coordinates.")
+                                    .c_str(),
+                                 FME_WARN);
+   }
+}
+
+//===========================================================================
+FME_Status FMECityJSONReader::scanForIds()
+{
+   gLogFile->logMessageString("Reading only the requested CityObjects from the input file.",
+                              FME_INFORM);
+
+   // Find where everything is at the top of the file, and parse all of it
+   // except the CityObjects and the vertices.
+   const char* data = inputFile_.begin();
+   std::vector<CityObjectSpan> members;
+   if (not scanJSONObjectMembers(data, 0, inputFile_.size(), members))
+   {
+      gLogFile->logMessageString("Not a CityJSON file", FME_ERROR);
+      return FME_FAILURE;
+   }
+
+   inputJSON_ = json::object();
+   const CityObjectSpan* cityObjectsMember(nullptr);
+   const CityObjectSpan* verticesMember(nullptr);
+   for (const auto& member : members)
+   {
+      const std::string key = decodeCityObjectId(member.id);
+      if (key == "CityObjects")
+      {
+         cityObjectsMember = &member;
+      }
+      else if (key == "vertices")
+      {
+         verticesMember = &member;
+      }
+      else
+      {
+         std::string errorMessage;
+         if (not parser_->parseValue(inputFile_, member.offset, member.length, inputJSON_[key], errorMessage))
+         {
+            gLogFile->logMessageString(("Unable to parse '" + key + "': " + errorMessage).c_str(),
+                                       FME_ERROR);
+            return FME_FAILURE;
+         }
+      }
+   }
+
+   // Now find the CityObjects we want, and parse just those.
+   json cityObjects = json::object();
+   std::vector<CityObjectSpan> spans;
+   if (cityObjectsMember and
+       not scanJSONObjectMembers(data, cityObjectsMember->offset, cityObjectsMember->length, spans))
+   {
+      gLogFile->logMessageString("Unable to parse the CityObjects", FME_ERROR);
+      return FME_FAILURE;
+   }
+
+   std::vector<std::size_t> vertexIndices;
+   for (const auto& span : spans)
+   {
+      const std::string objectId = decodeCityObjectId(span.id);
+      json cityObject;
+      if (idsToRead_.count(objectId) > 0 and readCityObjectSpan(span, cityObject))
+      {
+         for (const auto& geometry : cityObject.value("geometry", json::array()))
+         {
+            collectVertexIndices(geometry.value("boundaries", json()), vertexIndices);
+         }
+         cityObjects[objectId] = std::move(cityObject);
+      }
+   }
+
+   if (cityObjects.size() < idsToRead_.size())
+   {
+      gLogFile->logMessageString((std::to_string(idsToRead_.size() - cityObjects.size()) +
+                                  " of the requested CityObject IDs were not found.")
+                                    .c_str(),
+                                 FME_WARN);
+   }
+
+   // Only keep the vertices these CityObjects use, and point them at where
+   // they ended up.
+   std::sort(vertexIndices.begin(), vertexIndices.end());
+   vertexIndices.erase(std::unique(vertexIndices.begin(), vertexIndices.end()), vertexIndices.end());
+   for (auto& cityObject : cityObjects)
+   {
+      auto geometries = cityObject.find("geometry");
+      if (geometries == cityObject.end())
+      {
+         continue;
+      }
+      for (auto& geometry : *geometries)
+      {
+         auto boundaries = geometry.find("boundaries");
+         if (boundaries != geometry.end())
+         {
+            remapVertexIndices(*boundaries, vertexIndices);
+         }
+      }
+   }
+
+   std::vector<std::pair<std::size_t, std::size_t>> vertexSpans;
+   if (not vertexIndices.empty() and
+       (not verticesMember or
+        not scanJSONArrayElements(
+           data, verticesMember->offset, verticesMember->length, vertexIndices, vertexSpans)))
+   {
+      gLogFile->logMessageString("The CityObjects use vertices that are not in the file.", FME_ERROR);
+      return FME_FAILURE;
+   }
+
+   vertices_.clear();
+   vertices_.reserve(vertexSpans.size());
+   std::size_t badVertices(0);
+   for (const auto& [offset, length] : vertexSpans)
+   {
+      json vertex;
+      std::string errorMessage;
+      double coords[3];
+      bool parsed = parser_->parseValue(inputFile_, offset, length, vertex, errorMessage);
+      try
+      {
+         if (parsed and not decodeVertex(vertex, coords)) ++badVertices;
+      }
+      catch (json::exception& e)
+      {
+         parsed = false;
+      }
+      if (not parsed)
+      {
+         gLogFile->logMessageString(("Unable to parse the vertex at byte " + std::to_string(offset))
+                                       .c_str(),
+                                    FME_ERROR);
+         return FME_FAILURE;
+      }
+      vertices_.emplace_back(coords[0], coords[1], coords[2]);
+   }
+   logBadVertices(badVertices);
+
+   inputJSON_["CityObjects"] = std::move(cityObjects);
+   return FME_SUCCESS;
+}
+
+//===========================================================================
+void FMECityJSONReader::readTemplateExtents()
+{
+   templateExtents_.clear();
+   auto geometryTemplates = inputJSON_.find("geometry-templates");
+   if (geometryTemplates == inputJSON_.end() or not geometryTemplates->is_object())
+   {
+      return;
+   }
+
+   const json templates         = geometryTemplates->value("templates", json::array());
+   const json verticesTemplates = geometryTemplates->value("vertices-templates", json::array());
+   for (const auto& geometryTemplate : templates)
+   {
+      // An empty extent has its min above its max.
+      const double inf = std::numeric_limits<double>::infinity();
+      std::array<double, 6> extent{inf, inf, inf, -inf, -inf, -inf};
+
+      std::vector<std::size_t> indices;
+      if (geometryTemplate.is_object() and geometryTemplate.contains("boundaries"))
+      {
+         collectVertexIndices(geometryTemplate.at("boundaries"), indices);
+      }
+      for (std::size_t i : indices)
+      {
+         if (i >= verticesTemplates.size()) continue;
+         const json& vertex = verticesTemplates[i];
+         if (not vertex.is_array() or vertex.size() < 3) continue;
+         for (std::size_t c = 0; c < 3; ++c)
+         {
+            if (not vertex[c].is_number()) continue;
+            extent[c]     = std::min(extent[c], vertex[c].get<double>());
+            extent[c + 3] = std::max(extent[c + 3], vertex[c].get<double>());
+         }
+      }
+      templateExtents_.push_back(extent);
+   }
+}
+
+//===========================================================================
+FMECityJSONBox FMECityJSONReader::cityObjectBox(const json& cityObject,
+                                                const VertexPool3D& vertices) const
+{
+   FMECityJSONBox box;
+   auto geometries = cityObject.find("geometry");
+   if (geometries == cityObject.end() or not geometries->is_array())
+   {
+      return box;
+   }
+
+   for (const auto& geometry : *geometries)
+   {
+      if (not geometry.is_object() or not geometry.contains("boundaries"))
+      {
+         continue;
+      }
+      const json& boundaries = geometry.at("boundaries");
+      if (geometry.value("type", "") != "GeometryInstance")
+      {
+         addBoundariesToBox(boundaries, vertices, box);
+         continue;
+      }
+
+      // A GeometryInstance is a template, put in place by its transformationMatrix
+      // and then moved to the one vertex in its boundaries.  We use the corners
+      // of the template's extent, which may be a little bigger than it has to be.
+      if (not boundaries.is_array() or boundaries.empty() or not boundaries[0].is_number_integer() or
+          boundaries[0].get<std::int64_t>() < 0 or boundaries[0].get<std::size_t>() >= vertices.size())
+      {
+         continue;
+      }
+      const std::size_t origin = boundaries[0].get<std::size_t>();
+      const double originX     = vertices.x(origin);
+      const double originY     = vertices.y(origin);
+
+      auto matrix   = geometry.find("transformationMatrix");
+      const int tId = geometry.value("template", -1);
+      if (tId < 0 or std::size_t(tId) >= templateExtents_.size() or matrix == geometry.end() or
+          not matrix->is_array() or matrix->size() < 8 or
+          templateExtents_[tId][0] > templateExtents_[tId][3])
       {
-         fmeGeometryTools_->destroyGeometry(aggregate);
-         aggregate = nullptr;
+         box.expand(originX, originY);
+         continue;
       }
-      else if (aggregate->numParts() == 1)
+
+      const std::array<double, 6>& extent = templateExtents_[tId];
+      double m[8];
+      for (std::size_t i = 0; i < 8; ++i)
       {
-         feature.setGeometry(aggregate->removeLastPart());
-         fmeGeometryTools_->destroyGeometry(aggregate);
-         aggregate = nullptr;
+         m[i] = (*matrix)[i].is_number() ? (*matrix)[i].get<double>() : 0.0;
       }
-      else
+      for (int corner = 0; corner < 8; ++corner)
       {
-         feature.setGeometry(aggregate);
-         aggregate = nullptr;
+         const double x = extent[(corner & 1) ? 3 : 0];
+         const double y = extent[(corner & 2) ? 4 : 1];
+         const double z = extent[(corner & 4) ? 5 : 2];
+         box.expand(originX + m[0] * x + m[1] * y + m[2] * z + m[3],
+                    originY + m[4] * x + m[5] * y + m[6] * z + m[7]);
       }
+   }
+   return box;
+}
 
-      ++nextObject_;
+//===========================================================================
+void FMECityJSONReader::selectCityObjectsInEnvelope()
+{
+   const std::size_t count = objectIndex_.size();
+   inSearchEnvelope_.assign(count, false);
 
-      endOfFile = FME_FALSE;
-      return FME_SUCCESS;
+   std::vector<std::size_t> inside;
+   spatialIndex_.search(searchEnvelope_, inside);
+   for (std::size_t i : inside)
+   {
+      inSearchEnvelope_[i] = true;
+   }
+   if (envelopeReadsNoGeometry_)
+   {
+      for (std::size_t i : objectsWithoutBox_)
+      {
+         inSearchEnvelope_[i] = true;
+      }
+   }
+
+   if (envelopeReadsRelatives_)
+   {
+      // Go up through all the parents, and down through all the children, of
+      // the ones inside.  But not sideways, to the other children of a parent,
+      // or we would read a whole CityObjectGroup because one member is inside.
+      for (const bool up : {true, false})
+      {
+         std::vector<bool> visited(count, false);
+         std::vector<std::size_t> toVisit(inside);
+         while (not toVisit.empty())
+         {
+            const std::size_t i = toVisit.back();
+            toVisit.pop_back();
+            auto [related, end] = up ? objectIndex_.parents(i) : objectIndex_.children(i);
+            for (; related != end; ++related)
+            {
+               if (not visited[*related])
+               {
+                  visited[*related]           = true;
+                  inSearchEnvelope_[*related] = true;
+                  toVisit.push_back(*related);
+               }
+            }
+         }
+      }
    }
+
+   const std::size_t selected = std::count(inSearchEnvelope_.begin(), inSearchEnvelope_.end(), true);
+   gLogFile->logMessageString(("Reading " + std::to_string(selected) + " of the " +
+                               std::to_string(count) + " CityObjects for the search envelope.")
+                                 .c_str(),
+                              FME_INFORM);
 }
 
 void FMECityJSONReader::parseAttributes(IFMEFeature& feature,
                                         json::iterator& it,
-                                        const json::iterator& _end)
+                                        const json::iterator& _end,
+                                        const std::unordered_set<std::string>* attributesToRead)
 {
-   while (it != _end)
+   for (; it != _end; it++)
    {
       const std::string& attributeName = it.key();
+      if (attributesToRead != nullptr and attributesToRead->count(attributeName) == 0)
+      {
+         continue;
+      }
+
       if (it.value().is_string())
       {
          std::string attributeValue = it.value().get<std::string>();
@@ -1237,13 +2503,11 @@ void FMECityJSONReader::parseAttributes(IFMEFeature& feature,
          std::string attributeValue = it.value().dump();
          feature.setAttribute(attributeName.c_str(), attributeValue.c_str());
       }
-
-      it++;
    }
 }
 
-IFMEGeometry* FMECityJSONReader::parseCityObjectGeometry(json::value_type& currentGeometry,
-                                                         VertexPool3D& vertices,
+IFMEGeometry* FMECityJSONReader::parseCityObjectGeometry(const json& currentGeometry,
+                                                         const VertexPool3D& vertices,
                                                          const std::string& LODToUse,
                                                          bool readGeomsForAllLOD)
 {
@@ -1251,20 +2515,20 @@ IFMEGeometry* FMECityJSONReader::parseCityObjectGeometry(json::value_type& curre
    {
       std::string geometryType, geometryLodValue;
       std::string geometryLodName = "cityjson_lod"; // geometry Trait name
-      json::value_type boundaries = currentGeometry["boundaries"];
-      json::value_type semantics  = currentGeometry["semantics"];
+      const json& boundaries      = member(currentGeometry, "boundaries");
+      const json& semantics       = member(currentGeometry, "semantics");
 
       // Does this have any texture data attached?
-      json::value_type textures = currentGeometry["texture"];
-      json::value_type textureRefsToUse(json{nullptr});
-      if (not textures.is_null())
+      const json& textures           = member(currentGeometry, "texture");
+      const json* textureRefsToUse   = &nullJSON();
+      if (textures.is_object() and not textures.empty())
       {
          // TODO: issue 71: I guess here we could use the textureThemes to decide 
          // how to attach them, or which to use.
          // For now I think FME can only store one.
          // As an arbitrary choice, for now, let's just pick the first one.
          std::string themeToUse = textures.begin().key();
-         textureRefsToUse       = textures.begin().value()["values"];
+         textureRefsToUse       = &member(textures.begin().value(), "values");
 
          // TODO: issue 72: Texture Themes are not put on the feature or geometry anywhere.
          //       Is this really not needed?  Maybe it is only used in some
@@ -1272,16 +2536,16 @@ IFMEGeometry* FMECityJSONReader::parseCityObjectGeometry(json::value_type& curre
       }
 
       // Does this have any material data attached?
-      json::value_type materials = currentGeometry["material"];
-      json::value_type materialRefsToUse(json{nullptr});
-      if (not materials.is_null())
+      const json& materials         = member(currentGeometry, "material");
+      const json* materialRefsToUse = &nullJSON();
+      if (materials.is_object() and not materials.empty())
       {
          // TODO: issue 71: I guess here we could use the materialNames to decide
          // how to attach them, or which to use.
          // For now I think FME can only store one.
          // As an arbitrary choice, for now, let's just pick the first one.
          std::string nameToUse = materials.begin().key();
-         materialRefsToUse     = materials.begin().value()["values"];
+         materialRefsToUse     = &member(materials.begin().value(), "values");
 
          // TODO: issue 72: Material Names are not put on the feature or geometry anywhere.
          //       Is this really not needed?  Maybe it is only used in some
@@ -1289,9 +2553,10 @@ IFMEGeometry* FMECityJSONReader::parseCityObjectGeometry(json::value_type& curre
       }
 
       // geometry type and level of detail
-      if (!currentGeometry["type"].empty())
+      const json& type = member(currentGeometry, "type");
+      if (type.is_string())
       {
-         geometryType = currentGeometry["type"].get<std::string>();
+         geometryType = type.get<std::string>();
       }
       if (geometryType != "GeometryInstance")
       {
@@ -1300,7 +2565,7 @@ IFMEGeometry* FMECityJSONReader::parseCityObjectGeometry(json::value_type& curre
       else
       {
          int tId          = currentGeometry.at("template");
-         geometryLodValue = lodToString(inputJSON_.at("geometry-templates").at("templates")[tId]);
+         geometryLodValue = lodToString(inputJSON_.at("geometry-templates").at("templates").at(tId));
       }
 
       if (not geometryType.empty())
@@ -1324,7 +2589,7 @@ IFMEGeometry* FMECityJSONReader::parseCityObjectGeometry(json::value_type& curre
             else if (geometryType == "MultiSurface")
             {
                IFMEMultiSurface* msurface = fmeGeometryTools_->createMultiSurface();
-               parseMultiCompositeSurface(msurface, boundaries, semantics, fetchSemanticsValues(semantics), textureRefsToUse, materialRefsToUse, vertices);
+               parseMultiCompositeSurface(msurface, boundaries, semantics, fetchSemanticsValues(semantics), *textureRefsToUse, *materialRefsToUse, vertices);
                // Set the Level of Detail Trait on the geometry
                setTraitString(*msurface, geometryLodName, geometryLodValue);
                // Append the geometry to the FME feature
@@ -1333,43 +2598,50 @@ IFMEGeometry* FMECityJSONReader::parseCityObjectGeometry(json::value_type& curre
             else if (geometryType == "CompositeSurface")
             {
                IFMECompositeSurface* csurface = fmeGeometryTools_->createCompositeSurface();
-               parseMultiCompositeSurface(csurface, boundaries, semantics, fetchSemanticsValues(semantics), textureRefsToUse, materialRefsToUse, vertices);
+               parseMultiCompositeSurface(csurface, boundaries, semantics, fetchSemanticsValues(semantics), *textureRefsToUse, *materialRefsToUse, vertices);
                setTraitString(*csurface, geometryLodName, geometryLodValue);
                return csurface;
             }
             else if (geometryType == "Solid")
             {
                IFMEBRepSolid* BSolid =
-                  parseSolid(boundaries, semantics, fetchSemanticsValues(semantics), textureRefsToUse, materialRefsToUse, vertices);
+                  parseSolid(boundaries, semantics, fetchSemanticsValues(semantics), *textureRefsToUse, *materialRefsToUse, vertices);
                setTraitString(*BSolid, geometryLodName, geometryLodValue);
                return BSolid;
             }
             else if (geometryType == "MultiSolid")
             {
                IFMEMultiSolid* msolid = fmeGeometryTools_->createMultiSolid();
-               parseMultiCompositeSolid(msolid, boundaries, semantics, textureRefsToUse, materialRefsToUse, vertices);
+               parseMultiCompositeSolid(msolid, boundaries, semantics, *textureRefsToUse, *materialRefsToUse, vertices);
                setTraitString(*msolid, geometryLodName, geometryLodValue);
                return msolid;
             }
             else if (geometryType == "CompositeSolid")
             {
                IFMECompositeSolid* csolid = fmeGeometryTools_->createCompositeSolid();
-               parseMultiCompositeSolid(csolid, boundaries, semantics, textureRefsToUse, materialRefsToUse, vertices);
+               parseMultiCompositeSolid(csolid, boundaries, semantics, *textureRefsToUse, *materialRefsToUse, vertices);
                setTraitString(*csolid, geometryLodName, geometryLodValue);
                return csolid;
             }
             else if (geometryType == "GeometryInstance")
             {
+               // The origin is in the vertices of whatever this geometry came
+               // with, which in a Text Sequence is just the ones on its line.
+               int vtx = boundaries.at(0);
+               if ((vtx < 0) || (std::size_t(vtx) >= vertices.size()))
+               {
+                  gLogFile->logMessageString("GeometryInstance refers to a vertex that does not exist", FME_WARN);
+                  return nullptr;
+               }
                IFMEAggregate* ginst = fmeGeometryTools_->createAggregate();
                int templ            = currentGeometry.at("template");
                FME_UInt32 geomRef   = geomTemplateMap_[templ];
                ginst->setGeometryDefinitionReference(geomRef);
-               int vtx      = currentGeometry.at("boundaries")[0];
-               FME_Real64 x = std::get<0>(vertices_[vtx]);
-               FME_Real64 y = std::get<1>(vertices_[vtx]);
-               FME_Real64 z = std::get<2>(vertices_[vtx]);
+               FME_Real64 x = vertices.x(vtx);
+               FME_Real64 y = vertices.y(vtx);
+               FME_Real64 z = vertices.z(vtx);
                ginst->setGeometryInstanceLocalOrigin(x, y, z);
-               json::array_t tm   = currentGeometry.at("transformationMatrix");
+               const json& tm     = currentGeometry.at("transformationMatrix");
                FME_Real64 m[3][4] = {{tm[0], tm[1], tm[2], tm[3]},
                                      {tm[4], tm[5], tm[6], tm[7]},
                                      {tm[8], tm[9], tm[10], tm[11]}};
@@ -1393,53 +2665,50 @@ IFMEGeometry* FMECityJSONReader::parseCityObjectGeometry(json::value_type& curre
 }
 
 
-json::value_type* FMECityJSONReader::fetchSemanticsValues(json::value_type& semantics)
+const json* FMECityJSONReader::fetchSemanticsValues(const json& semantics)
 {
-   if ((not semantics.is_null()) && (not semantics["values"].is_null()))
-   {
-      return &semantics["values"];
-   }
-   return nullptr;
+   const json& values = member(semantics, "values");
+   return values.is_null() ? nullptr : &values;
 }
 
-json::value_type* FMECityJSONReader::fetchSemanticsValues(json::value_type& semanticsArray,
+const json* FMECityJSONReader::fetchSemanticsValues(const json& semanticsArray,
                                                           std::size_t index)
 {
-   if ((not semanticsArray.is_null()) && (semanticsArray["values"].is_array()) &&
-       (index < semanticsArray["values"].size()))
+   const json& values = member(semanticsArray, "values");
+   if (values.is_array() && (index < values.size()))
    {
-      return &semanticsArray["values"][index];
+      return &values[index];
    }
    return nullptr;
 }
 
 template <typename MCSolid>
 void FMECityJSONReader::parseMultiCompositeSolid(MCSolid multiCompositeSolid,
-                                                 json::value_type& boundaries,
-                                                 json::value_type& semantics,
-                                                 json::value_type& textureRefs,
-                                                 json::value_type& materialRefs,
-                                                 VertexPool3D& vertices)
+                                                 const json& boundaries,
+                                                 const json& semantics,
+                                                 const json& textureRefs,
+                                                 const json& materialRefs,
+                                                 const VertexPool3D& vertices)
 {
    for (int i = 0; i < boundaries.size(); i++)
    {
       IFMEBRepSolid* BSolid = parseSolid(boundaries[i],
                                          semantics,
                                          fetchSemanticsValues(semantics, i),
-                                         (textureRefs.is_null() ? textureRefs : textureRefs[i]),
-                                         (materialRefs.is_null() ? materialRefs : materialRefs[i]),
+                                         element(textureRefs, i),
+                                         element(materialRefs, i),
                                          vertices);
 
       multiCompositeSolid->appendPart(BSolid);
    }
 }
 
-IFMEBRepSolid* FMECityJSONReader::parseSolid(json::value_type& boundaries,
-                                             json::value_type& semantics,
-                                             json::value_type* semanticSrfVec2,
-                                             json::value_type& textureRefs,
-                                             json::value_type& materialRefs,
-                                             VertexPool3D& vertices)
+IFMEBRepSolid* FMECityJSONReader::parseSolid(const json& boundaries,
+                                             const json& semantics,
+                                             const json* semanticSrfVec2,
+                                             const json& textureRefs,
+                                             const json& materialRefs,
+                                             const VertexPool3D& vertices)
 {
    IFMEBRepSolid* BSolid(nullptr);
    IFMECompositeSurface* outerSurface = fmeGeometryTools_->createCompositeSurface();
@@ -1448,13 +2717,13 @@ IFMEBRepSolid* FMECityJSONReader::parseSolid(json::value_type& boundaries,
    for (int i = 0; i < boundaries.size(); i++)
    {
       // Inner shells/surfaces do not have semantics
-      json::value_type* semanticSrfVec(nullptr);
+      const json* semanticSrfVec(nullptr);
       if (i == 0)
       {
          // Does this have any semantic data?
-         if (semanticSrfVec2 && (not(*semanticSrfVec2)[i].is_null()))
+         if (semanticSrfVec2 && (not element(*semanticSrfVec2, i).is_null()))
          {
-            semanticSrfVec = &(*semanticSrfVec2)[i];
+            semanticSrfVec = &element(*semanticSrfVec2, i);
          }
       }
       else
@@ -1471,8 +2740,8 @@ IFMEBRepSolid* FMECityJSONReader::parseSolid(json::value_type& boundaries,
                                  boundaries[i],
                                  semantics,
                                  semanticSrfVec,
-                                 (textureRefs.is_null() ? textureRefs : textureRefs[i]),
-                                 (materialRefs.is_null() ? materialRefs : materialRefs[i]),
+                                 element(textureRefs, i),
+                                 element(materialRefs, i),
                                  vertices);
 
       if (i == 0)
@@ -1498,22 +2767,22 @@ IFMEBRepSolid* FMECityJSONReader::parseSolid(json::value_type& boundaries,
 
 template <typename MCSurface>
 void FMECityJSONReader::parseMultiCompositeSurface(MCSurface multiCompositeSurface,
-                                                   json::value_type& boundaries,
-                                                   json::value_type& semantics,
-                                                   json::value_type* semanticSrfVec,
-                                                   json::value_type& textureRefs,
-                                                   json::value_type& materialRefs,
-                                                   VertexPool3D& vertices)
+                                                   const json& boundaries,
+                                                   const json& semantics,
+                                                   const json* semanticSrfVec,
+                                                   const json& textureRefs,
+                                                   const json& materialRefs,
+                                                   const VertexPool3D& vertices)
 {
    for (int i = 0; i < boundaries.size(); i++)
    {
       // Does this have any semantic data?
-      json::value_type* semanticSrf = (!semanticSrfVec || (*semanticSrfVec)[i].is_null()) ?
-                                         nullptr :
-                                         &semantics["surfaces"][int((*semanticSrfVec)[i])];
+      const json* semanticSrf = (!semanticSrfVec || element(*semanticSrfVec, i).is_null()) ?
+                                   nullptr :
+                                   &element(member(semantics, "surfaces"), int(element(*semanticSrfVec, i)));
 
-      IFMEFace* face = createOneSurface((textureRefs.is_null() ? textureRefs : textureRefs[i]),
-                                        (materialRefs.is_null() ? materialRefs : materialRefs[i]),
+      IFMEFace* face = createOneSurface(element(textureRefs, i),
+                                        element(materialRefs, i),
                                         boundaries[i],
                                         vertices,
                                         semanticSrf);
@@ -1522,11 +2791,11 @@ void FMECityJSONReader::parseMultiCompositeSurface(MCSurface multiCompositeSurfa
    }
 }
 
-IFMEFace* FMECityJSONReader::createOneSurface(json::value_type& textureRefs,
-                                              json::value_type& materialRefs,
-                                              json::value_type& boundaries,
-                                              VertexPool3D& vertices,
-                                              json::value_type* semanticSrf)
+IFMEFace* FMECityJSONReader::createOneSurface(const json& textureRefs,
+                                              const json& materialRefs,
+                                              const json& boundaries,
+                                              const VertexPool3D& vertices,
+                                              const json* semanticSrf)
 {
    IFMEFace* face = parseSurfaceBoundaries(boundaries, vertices, textureRefs);
 
@@ -1539,9 +2808,9 @@ IFMEFace* FMECityJSONReader::createOneSurface(json::value_type& textureRefs,
    return face;
 }
 
-IFMEFace* FMECityJSONReader::parseSurfaceBoundaries(json::value_type& surface,
-                                                    VertexPool3D& vertices,
-                                                    json::value_type& textureRefs)
+IFMEFace* FMECityJSONReader::parseSurfaceBoundaries(const json& surface,
+                                                    const VertexPool3D& vertices,
+                                                    const json& textureRefs)
 {
    std::vector<IFMELine*> rings;
    std::vector<FME_UInt32> appearanceRefs;
@@ -1572,7 +2841,7 @@ IFMEFace* FMECityJSONReader::parseSurfaceBoundaries(json::value_type& surface,
    return face;
 }
 
-void FMECityJSONReader::parseSemantics(IFMEFace& face, json::value_type* semanticSurface)
+void FMECityJSONReader::parseSemantics(IFMEFace& face, const json* semanticSurface)
 {
    // Setting semantics
    if (semanticSurface && (not semanticSurface->is_null()))
@@ -1583,7 +2852,7 @@ void FMECityJSONReader::parseSemantics(IFMEFace& face, json::value_type* semanti
       face.setName(*geometryName, nullptr);
       gFMESession->destroyString(geometryName);
 
-      for (json::iterator it = semanticSurface->begin(); it != semanticSurface->end(); it++)
+      for (auto it = semanticSurface->begin(); it != semanticSurface->end(); it++)
       {
          if (it.key() == "children" || it.key() == "parent")
          {
@@ -1634,7 +2903,7 @@ void FMECityJSONReader::parseSemantics(IFMEFace& face, json::value_type* semanti
    }
 }
 
-void FMECityJSONReader::parseMaterials(IFMEFace& face, json::value_type& materialRef)
+void FMECityJSONReader::parseMaterials(IFMEFace& face, const json& materialRef)
 {
    if (not materialRef.is_null())
    {
@@ -1736,30 +3005,29 @@ void FMECityJSONReader::parseMaterials(IFMEFace& face, json::value_type& materia
 }
 
 void FMECityJSONReader::parseMultiLineString(IFMEMultiCurve* mlinestring,
-                                             json::value_type& boundaries,
-                                             VertexPool3D& vertices)
+                                             const json& boundaries,
+                                             const VertexPool3D& vertices)
 {
    for (auto& linestring : boundaries)
    {
       IFMELine* line = fmeGeometryTools_->createLine();
       std::optional<FME_UInt32> unusedRef;
-      json::value_type textureRefs(json{nullptr});
-      parseLineString(line, unusedRef, linestring, vertices, textureRefs);
+      parseLineString(line, unusedRef, linestring, vertices, nullJSON());
       mlinestring->appendPart(line);
    }
 }
 
 void FMECityJSONReader::parseRings(std::vector<IFMELine*>& rings,
                                    std::vector<FME_UInt32>& appearanceRefs,
-                                   json::value_type& boundary,
-                                   VertexPool3D& vertices,
-                                   json::value_type& textureRefs)
+                                   const json& boundary,
+                                   const VertexPool3D& vertices,
+                                   const json& textureRefs)
 {
    for (int i = 0; i < boundary.size(); i++)
    {
       IFMELine* line = fmeGeometryTools_->createLine();
       std::optional<FME_UInt32> appearanceRef;
-      parseLineString(line, appearanceRef, boundary[i], vertices, textureRefs[i]);
+      parseLineString(line, appearanceRef, boundary[i], vertices, element(textureRefs, i));
       rings.push_back(line);
       if (appearanceRef)
       {
@@ -1770,56 +3038,107 @@ void FMECityJSONReader::parseRings(std::vector<IFMELine*>& rings,
 
 void FMECityJSONReader::parseLineString(IFMELine* line,
                                         std::optional<FME_UInt32>& appearanceRef,
-                                        json::value_type& boundary,
-                                        VertexPool3D& vertices,
-                                        json::value_type& textureRefs)
+                                        const json& boundary,
+                                        const VertexPool3D& vertices,
+                                        const json& textureRefs)
 {
+   if (boundary.empty())
+   {
+      return;
+   }
+
    // the textureRefs include one reference to the texture plus all the vertexcoord references
    // so we should make sure it all matches up.
-   bool useTexCoords = ((boundary.size() + 1) == textureRefs.size());
-   int vertexCoordIndex(0);
-   for (int vertex : boundary)
+   const std::size_t numPoints = boundary.size();
+   bool useTexCoords = ((numPoints + 1) == textureRefs.size()) and textureRefs[0].is_number_integer();
+
+   // Some datasets do not have the texture coordinates they claim to need.  Rather
+   // than making some up, the ring gets no texture at all, so the gap shows.
+   if (useTexCoords)
    {
-      if (useTexCoords && (vertexCoordIndex == 0))
+      ringU_.resize(numPoints);
+      ringV_.resize(numPoints);
+      for (std::size_t i = 0; useTexCoords and i < numPoints; ++i)
+      {
+         const json& uvRef = (i + 1 < textureRefs.size()) ? textureRefs[i + 1] : nullJSON();
+         useTexCoords = uvRef.is_number_unsigned() and uvRef.get<std::size_t>() < textureVertices_.size();
+         if (useTexCoords)
+         {
+            ringU_[i] = std::get<0>(textureVertices_[uvRef.get<std::size_t>()]);
+            ringV_[i] = std::get<1>(textureVertices_[uvRef.get<std::size_t>()]);
+         }
+      }
+      if (not useTexCoords and limitLogging_["missingTextureCoordinates"]++ == 0)
       {
-         appearanceRef = texturesMap_[textureRefs[0]]; // texture reference is the first one.
+         gLogFile->logMessageString(
+            "Some rings refer to texture coordinates that are not in the file, so they are read without their texture.",
+            FME_WARN);
       }
-      vertexCoordIndex++;
-      IFMEPoint* point = fmeGeometryTools_->createPointXYZ(std::get<0>(vertices[vertex]),
-                                                            std::get<1>(vertices[vertex]),
-                                                            std::get<2>(vertices[vertex]));
+   }
+   if (useTexCoords)
+   {
+      appearanceRef = getTextureAppearance(textureRefs[0]); // texture reference is the first one.
+   }
+
+#ifdef FME_CITYJSON_LINE_ARRAYS
+   // Rather than making a point for every vertex, let's gather up the whole
+   // ring in the scratch arrays and hand it to the line all at once.
+   ringX_.resize(numPoints);
+   ringY_.resize(numPoints);
+   ringZ_.resize(numPoints);
+
+   std::size_t i(0);
+   for (const auto& vertexRef : boundary)
+   {
+      const int vertex = vertexRef;
+      ringX_[i]        = vertices.x(vertex);
+      ringY_[i]        = vertices.y(vertex);
+      ringZ_[i]        = vertices.z(vertex);
+      ++i;
+   }
 
+   line->appendPoints(FME_UInt32(numPoints), ringX_.data(), ringY_.data(), ringZ_.data());
+
+   if (useTexCoords)
+   {
+      line->addNamedMeasure(*textureCoordUName_, 0.0);
+      line->addNamedMeasure(*textureCoordVName_, 0.0);
+      line->setNamedMeasureValues(*textureCoordUName_, ringU_.data());
+      line->setNamedMeasureValues(*textureCoordVName_, ringV_.data());
+   }
+#else
+   // This SDK can't build a line from arrays, so it's a point at a time.
+   std::size_t i(0);
+   for (const auto& vertexRef : boundary)
+   {
+      const int vertex = vertexRef;
+      IFMEPoint* point = fmeGeometryTools_->createPointXYZ(vertices.x(vertex),
+                                                            vertices.y(vertex),
+                                                            vertices.z(vertex));
       if (useTexCoords)
       {
-         // Some datasets do not have the texture coordinates they claim to need.
-         int uvRef = textureRefs[vertexCoordIndex];
-         if (uvRef < textureVertices_.size())
-         {
-            point->setNamedMeasure(*textureCoordUName_, std::get<0>(textureVertices_[uvRef]));
-            point->setNamedMeasure(*textureCoordVName_, std::get<1>(textureVertices_[uvRef]));
-         }
-         else
-         {
-            // TODO: log a warning here that some texture coordinates are missing from the file.
-         }
+         point->setNamedMeasure(*textureCoordUName_, ringU_[i]);
+         point->setNamedMeasure(*textureCoordVName_, ringV_[i]);
       }
+      ++i;
 
       line->appendPoint(point);
       point = nullptr; // We no longer own this.
    }
+#endif
 }
 
 void FMECityJSONReader::parseMultiPoint(IFMEMultiPoint* mpoint,
-                                        json::value_type& boundary,
-                                        VertexPool3D& vertices)
+                                        const json& boundary,
+                                        const VertexPool3D& vertices)
 {
-   for (json::iterator it = boundary.begin(); it != boundary.end(); it++)
+   for (const auto& part : boundary)
    {
-      for (int vertex : it.value())
+      for (int vertex : part)
       {
-         IFMEPoint* point = fmeGeometryTools_->createPointXYZ(std::get<0>(vertices[vertex]),
-                                                              std::get<1>(vertices[vertex]),
-                                                              std::get<2>(vertices[vertex]));
+         IFMEPoint* point = fmeGeometryTools_->createPointXYZ(vertices.x(vertex),
+                                                              vertices.y(vertex),
+                                                              vertices.z(vertex));
          mpoint->appendPart(point);
       }
    }
@@ -1841,17 +3160,14 @@ void FMECityJSONReader::setTraitString(IFMEGeometry& geometry,
    gFMESession->destroyString(value);
 }
 
-std::string FMECityJSONReader::lodToString(json currentGeometry)
+std::string FMECityJSONReader::lodToString(const json& currentGeometry)
 {
-   json::value_type lod;
-   try
-   {
-      lod = currentGeometry.at("lod");
-   }
-   catch (json::out_of_range& e)
+   auto found = currentGeometry.find("lod");
+   if (found == currentGeometry.end())
    {
       return "";
    }
+   const json& lod = *found;
    if (lod.is_number_integer())
    {
       return std::to_string(int(lod)) + ".0";
@@ -1918,6 +3234,10 @@ FME_Status FMECityJSONReader::readSchema(IFMEFeature& feature, FME_Boolean& endO
    }
 
    // Create a feature for the metadata
+   if (not schemaScanDoneMeta_ and not typesToRead_.empty() and typesToRead_.count("Metadata") == 0)
+   {
+      schemaScanDoneMeta_ = true;
+   }
    if (not schemaScanDoneMeta_)
    {
       try
@@ -1961,15 +3281,15 @@ FME_Status FMECityJSONReader::readSchema(IFMEFeature& feature, FME_Boolean& endO
 
    if (not schemaScanDone_ and schemaScanDoneMeta_)
    {
-      // iterate through every object in the file.
-      for (auto& cityObject : inputJSON_.at("CityObjects"))
+      // We already went through every object in the file when it was opened, and
+      // summed up what we found for each feature type.  Now make that into
+      // schema features.
+      for (const auto& [featureType, summary] : objectIndex_.featureTypes())
       {
-         // I'm not sure exactly what types of features this reader will
-         // produce, so this is just a wild guess as an example.
-
-         // Let's find out what we will be using as the "feature_type", and
-         // group the schema features by that.  I'll pick the field "type".
-         std::string featureType = cityObject.at("type").get<std::string>();
+         if (not typesToRead_.empty() and typesToRead_.count(featureType) == 0)
+         {
+            continue;
+         }
 
          // Let's see if we already have seen a feature of this 'type'.
          // If not, create a new schema feature.  If we have, just add to it I guess.
@@ -1989,118 +3309,50 @@ FME_Status FMECityJSONReader::readSchema(IFMEFeature& feature, FME_Boolean& endO
          // Set the feature ID attribute
          // Schema feature attributes need to be set with setSequencedAttribute()
          // to preserve the order of attributes.
-         {
-            const std::string attributeName = "fid";
-            std::string attributeType       = "string";
-            sf->setSequencedAttribute(attributeName.c_str(), attributeType.c_str());
-         }
+         sf->setSequencedAttribute("fid", "string");
 
-         // iterate through every attribute on this object.
-         if (not cityObject["attributes"].is_null())
+         for (const auto& [attributeName, attributeType] : summary.attributes)
          {
-            for (json::iterator it = cityObject.at("attributes").begin();
-                 it != cityObject.at("attributes").end();
-                 ++it)
+            if (attributesToRead_.empty() or attributesToRead_.count(attributeName) > 0)
             {
-               const std::string& attributeName = it.key();
-               // The value here must be something found in the left hand
-               // column of the ATTR_TYPE_MAP line in the metafile 'fmecityjson.fmf'
-               // could be string, real64, uint32, logical, char, date, time, etc.
-
-               if (it.value().is_string())
-               {
-                  std::string attributeType = "string";
-                  // Schema feature attributes need to be set with setSequencedAttribute()
-                  // to preserve the order of attributes.
-                  sf->setSequencedAttribute(attributeName.c_str(), attributeType.c_str());
-               }
-               else if (it.value().is_number_float())
-               {
-                  std::string attributeType = "real64";
-                  sf->setSequencedAttribute(attributeName.c_str(), attributeType.c_str());
-               }
-               else if (it.value().is_number_integer())
-               {
-                  std::string attributeType = "int32";
-                  sf->setSequencedAttribute(attributeName.c_str(), attributeType.c_str());
-               }
-               else if (it.value().is_boolean())
-               {
-                  std::string attributeType = "logical";
-                  sf->setSequencedAttribute(attributeName.c_str(), attributeType.c_str());
-               }
-               else if (invalidAttributeValueTypesLogged_
-                           .insert(attributeName + it.value().type_name())
-                           .second)
-               {
-                  // If this is the first time we've detected that an attribute with this name
-                  // has this type, log a warning
-                  std::string msg = "Attribute value type '";
-                  msg.append(it.value().type_name());
-                  msg.append("' is not allowed, in '");
-                  msg.append(attributeName);
-                  msg.append("'.");
-                  gLogFile->logMessageString(msg.c_str(), FME_WARN);
-               }
+               sf->setSequencedAttribute(attributeName.c_str(), attributeType.c_str());
             }
          }
 
-         // Here we add to the schema feature all the possible geometries of the
-         // feature type.  Arc and ellipse geometries require that you also set
-         // fme_geomattr on them.  Setting the fme_geomattr is required for
-         // backwards compatible with writers that only support classic geometry.
-
-         // The value here must be something found in the left hand
-         // column of the GEOM_MAP line in the metafile 'fmecityjson.fmf'
-         int nrGeometries = cityObject.at("geometry").size();
-         if (nrGeometries == 0)
+         if (summary.emptyGeometries > 0)
          {
-            gLogFile->logMessageString("Empty geometry for CityObject", FME_WARN);
-            std::string attributeName = "fme_geometry{0}";
-            sf->setAttribute(attributeName.c_str(), "fme_no_geom");
+            gLogFile->logMessageString((std::to_string(summary.emptyGeometries) + " " + featureType +
+                                        " CityObjects have an empty geometry.")
+                                          .c_str(),
+                                       FME_WARN);
          }
-         else
+         for (const auto& [i, geometryType] : summary.geometries)
          {
-            for (int i = 0; i < nrGeometries; i++)
-            {
-               std::string attributeName = "fme_geometry{" + std::to_string(i) + "}";
-               std::string type;
-               if (not cityObject.at("geometry")[i]["type"].empty())
-               {
-                  type = cityObject.at("geometry")[i]["type"].get<std::string>();
-               }
-               if (type == "GeometryInstance")
-               {
-                  int tId = cityObject.at("geometry")[i].at("template");
-                  type = inputJSON_["geometry-templates"]["templates"][tId]["type"].get<std::string>();
-               }
+            std::string attributeName = "fme_geometry{" + std::to_string(i) + "}";
+            sf->setAttribute(attributeName.c_str(), geometryType.c_str());
+         }
+      }
 
-               // Set the geometry types from the data
-               if (type == "MultiPoint")
-               {
-                  sf->setAttribute(attributeName.c_str(), "fme_point");
-               }
-               else if (type == "MultiLineString")
-               {
-                  sf->setAttribute(attributeName.c_str(), "fme_line");
-               }
-               else if ((type == "MultiSurface") || (type == "CompositeSurface"))
-               {
-                  sf->setAttribute(attributeName.c_str(), "fme_surface");
-               }
-               else if ((type == "Solid") || (type == "MultiSolid") || (type == "CompositeSolid"))
-               {
-                  sf->setAttribute(attributeName.c_str(), "fme_solid");
-               }
-               else
-               {
-                  gLogFile->logMessageString(("No match for geometry type " + type).c_str(), FME_WARN);
-                  sf->setAttribute(attributeName.c_str(), "fme_no_geom");
-               }
-            }
+      // If this is the first time we've detected that an attribute with this name
+      // has this type, log a warning
+      for (const auto& [attributeName, valueType] : objectIndex_.invalidAttributes())
+      {
+         if (invalidAttributeValueTypesLogged_.insert(attributeName + valueType).second)
+         {
+            std::string msg = "Attribute value type '";
+            msg.append(valueType);
+            msg.append("' is not allowed, in '");
+            msg.append(attributeName);
+            msg.append("'.");
+            gLogFile->logMessageString(msg.c_str(), FME_WARN);
          }
       }
 
+      for (const std::string& type : objectIndex_.unknownGeometryTypes())
+      {
+         gLogFile->logMessageString(("No match for geometry type " + type).c_str(), FME_WARN);
+      }
+
       schemaScanDone_ = true;
    }
 
@@ -2121,6 +3373,101 @@ FME_Status FMECityJSONReader::readSchema(IFMEFeature& feature, FME_Boolean& endO
    return FME_SUCCESS;
 }
 
+//===========================================================================
+void FMECityJSONReader::addCityObjectToSchema(const json& cityObject,
+                                              FMECityJSONObjectIndex::FeatureType& featureType)
+{
+   // iterate through every attribute on this object.
+   auto attributes = cityObject.find("attributes");
+   if (attributes != cityObject.end() and attributes->is_object())
+   {
+      for (auto it = attributes->begin(); it != attributes->end(); ++it)
+      {
+         const std::string& attributeName = it.key();
+         // The value here must be something found in the left hand
+         // column of the ATTR_TYPE_MAP line in the metafile 'fmecityjson.fmf'
+         // could be string, real64, uint32, logical, char, date, time, etc.
+
+         if (it.value().is_string())
+         {
+            featureType.setAttributeType(attributeName, "string");
+         }
+         else if (it.value().is_number_float())
+         {
+            featureType.setAttributeType(attributeName, "real64");
+         }
+         else if (it.value().is_number_integer())
+         {
+            featureType.setAttributeType(attributeName, "int32");
+         }
+         else if (it.value().is_boolean())
+         {
+            featureType.setAttributeType(attributeName, "logical");
+         }
+         else
+         {
+            objectIndex_.addInvalidAttribute(attributeName, it.value().type_name());
+         }
+      }
+   }
+
+   // Here we add to the schema all the possible geometries of the
+   // feature type.  Arc and ellipse geometries require that you also set
+   // fme_geomattr on them.  Setting the fme_geomattr is required for
+   // backwards compatible with writers that only support classic geometry.
+
+   // The value here must be something found in the left hand
+   // column of the GEOM_MAP line in the metafile 'fmecityjson.fmf'
+   const json& geometries = cityObject.at("geometry");
+   int nrGeometries = geometries.size();
+   if (nrGeometries == 0)
+   {
+      featureType.emptyGeometries++;
+      featureType.geometries[0] = "fme_no_geom";
+   }
+   else
+   {
+      for (int i = 0; i < nrGeometries; i++)
+      {
+         std::string type;
+         auto typeValue = geometries[i].find("type");
+         if (typeValue != geometries[i].end() and not typeValue->empty())
+         {
+            type = typeValue->get<std::string>();
+         }
+         if (type == "GeometryInstance")
+         {
+            int tId = geometries[i].at("template");
+            type = inputJSON_.at("geometry-templates").at("templates").at(tId).at("type").get<std::string>();
+         }
+
+         // Set the geometry types from the data
+         std::string& geometryType = featureType.geometries[i];
+         if (type == "MultiPoint")
+         {
+            geometryType = "fme_point";
+         }
+         else if (type == "MultiLineString")
+         {
+            geometryType = "fme_line";
+         }
+         else if ((type == "MultiSurface") || (type == "CompositeSurface"))
+         {
+            geometryType = "fme_surface";
+         }
+         else if ((type == "Solid") || (type == "MultiSolid") || (type == "CompositeSolid"))
+         {
+            geometryType = "fme_solid";
+         }
+         else
+         {
+            objectIndex_.addUnknownGeometryType(type);
+            geometryType = "fme_no_geom";
+         }
+      }
+   }
+}
+
 //===========================================================================
 FME_Status FMECityJSONReader::fetchSchemaFeaturesForWriter()
 {
@@ -2159,7 +3506,119 @@ void FMECityJSONReader::readParametersDialog()
       // Log that no parameter value was entered.
       gLogFile->logMessageString(kMsgNoLodParam, FME_INFORM);
    }
+
+   if (gMappingFile->fetchWithPrefix(
+          readerKeyword_.c_str(), readerTypeName_.c_str(), kSrcStreamParamTag, *paramValue))
+   {
+      streamCityObjects_ = (std::string(paramValue->data()) == "Yes");
+      gLogFile->logMessageString((kStreamParamTag + std::string(paramValue->data())).c_str(),
+                                 FME_INFORM);
+   }
+
+   if (gMappingFile->fetchWithPrefix(
+          readerKeyword_.c_str(), readerTypeName_.c_str(), kSrcParserParamTag, *paramValue))
+   {
+      if (std::string(paramValue->data()).size() > 0)
+      {
+         parserParam_ = paramValue->data();
+      }
+      gLogFile->logMessageString((kParserParamTag + parserParam_).c_str(), FME_INFORM);
+   }
+
+   if (gMappingFile->fetchWithPrefix(
+          readerKeyword_.c_str(), readerTypeName_.c_str(), kSrcIdsToReadParamTag, *paramValue))
+   {
+      splitList(paramValue->data(), idsToRead_);
+      gLogFile->logMessageString((kIdsToReadParamTag + std::string(paramValue->data())).c_str(),
+                                 FME_INFORM);
+   }
+
+   if (gMappingFile->fetchWithPrefix(
+          readerKeyword_.c_str(), readerTypeName_.c_str(), kSrcTypesToReadParamTag, *paramValue))
+   {
+      splitList(paramValue->data(), typesToRead_);
+      gLogFile->logMessageString((kTypesToReadParamTag + std::string(paramValue->data())).c_str(),
+                                 FME_INFORM);
+   }
+
+   if (gMappingFile->fetchWithPrefix(readerKeyword_.c_str(),
+                                     readerTypeName_.c_str(),
+                                     kSrcAttributesToReadParamTag,
+                                     *paramValue))
+   {
+      splitList(paramValue->data(), attributesToRead_);
+      gLogFile->logMessageString(
+         (kAttributesToReadParamTag + std::string(paramValue->data())).c_str(), FME_INFORM);
+   }
+
+   if (gMappingFile->fetchWithPrefix(
+          readerKeyword_.c_str(), readerTypeName_.c_str(), kSrcIndexCacheParamTag, *paramValue))
+   {
+      useIndexCache_ = (std::string(paramValue->data()) == "Yes");
+      gLogFile->logMessageString((kIndexCacheParamTag + std::string(paramValue->data())).c_str(),
+                                 FME_INFORM);
+   }
+
+   if (gMappingFile->fetchWithPrefix(readerKeyword_.c_str(),
+                                     readerTypeName_.c_str(),
+                                     kSrcIndexCacheFullHashParamTag,
+                                     *paramValue))
+   {
+      indexCacheFullHash_ = (std::string(paramValue->data()) == "Yes");
+      gLogFile->logMessageString(
+         (kIndexCacheFullHashParamTag + std::string(paramValue->data())).c_str(), FME_INFORM);
+   }
+
+   if (gMappingFile->fetchWithPrefix(readerKeyword_.c_str(),
+                                     readerTypeName_.c_str(),
+                                     kSrcEnvelopeNoGeometryParamTag,
+                                     *paramValue))
+   {
+      envelopeReadsNoGeometry_ = (std::string(paramValue->data()) != "Skip");
+      gLogFile->logMessageString(
+         (kEnvelopeNoGeometryParamTag + std::string(paramValue->data())).c_str(), FME_INFORM);
+   }
+
+   if (gMappingFile->fetchWithPrefix(readerKeyword_.c_str(),
+                                     readerTypeName_.c_str(),
+                                     kSrcEnvelopeRelativesParamTag,
+                                     *paramValue))
+   {
+      envelopeReadsRelatives_ = (std::string(paramValue->data()) == "Yes");
+      gLogFile->logMessageString(
+         (kEnvelopeRelativesParamTag + std::string(paramValue->data())).c_str(), FME_INFORM);
+   }
    gFMESession->destroyString(paramValue);
+
+   // The search envelope is minx, miny, maxx, maxy.  All zeros means there isn't one.
+   searchEnvelope_ = FMECityJSONBox();
+   IFMEStringArray* envelope = gFMESession->createStringArray();
+   if (gMappingFile->fetchWithPrefix(
+          readerKeyword_.c_str(), readerTypeName_.c_str(), kSrcSearchEnvelopeParamTag, *envelope) and
+       envelope->entries() >= 4)
+   {
+      double values[4];
+      bool numbers(true);
+      for (FME_UInt32 i = 0; i < 4; ++i)
+      {
+         const char* text = envelope->elementAt(i)->data();
+         char* numberEnd(nullptr);
+         values[i] = std::strtod(text, &numberEnd);
+         numbers   = numbers and numberEnd != text;
+      }
+
+      if (numbers and (values[0] != 0.0 or values[1] != 0.0 or values[2] != 0.0 or values[3] != 0.0))
+      {
+         searchEnvelope_.expand(std::min(values[0], values[2]), std::min(values[1], values[3]));
+         searchEnvelope_.expand(std::max(values[0], values[2]), std::max(values[1], values[3]));
+         std::stringstream envelopeMsg;
+         envelopeMsg << std::setprecision(15) << kSearchEnvelopeParamTag << searchEnvelope_.minX
+                     << ", " << searchEnvelope_.minY << " - " << searchEnvelope_.maxX << ", "
+                     << searchEnvelope_.maxY;
+         gLogFile->logMessageString(envelopeMsg.str().c_str(), FME_INFORM);
+      }
+   }
+   gFMESession->destroyStringArray(envelope);
 }
 
 //=========================================================================
@@ -2245,7 +3704,7 @@ FME_Status FMECityJSONReader::readRaster(const std::string& fullFileName,
                                          IFMERaster*& raster,
                                          std::string readerToUse)
 {
-   IFMEUniversalReader* newReader(nullptr);
+   raster = nullptr;
    if (readerToUse.length() == 0)
    {
       readerToUse = "GENERIC";
@@ -2254,12 +3713,27 @@ FME_Status FMECityJSONReader::readRaster(const std::string& fullFileName,
    const FME_Boolean oldSilentMode = gLogFile->getSilent();
    gLogFile->silent(FME_TRUE); // don't forget to set this back to what it was before...
 
-   newReader = gFMESession->createReader(readerToUse.c_str(), FME_FALSE, nullptr);
-   if (!newReader)
+   // Get the correct reader.  Making a reader is expensive, so we keep one
+   // for each format and open it on each texture file in turn.
+   IFMEUniversalReader* newReader(nullptr);
+   auto it = rasterReaders_.find(readerToUse);
+   if (it != rasterReaders_.end())
    {
-      gLogFile->silent(oldSilentMode);
-      // TODO: Log some error message
-      return FME_FAILURE;
+      newReader = it->second;
+   }
+   else
+   {
+      // We haven't tried to make a reader for this format yet. Do it now.
+      newReader = gFMESession->createReader(readerToUse.c_str(), FME_FALSE, nullptr);
+      if (!newReader)
+      {
+         gLogFile->silent(oldSilentMode);
+         // TODO: Log some error message
+         return FME_FAILURE;
+      }
+
+      // Place the reader in our dictionary.
+      rasterReaders_[readerToUse] = newReader;
    }
 
    // Now let's make a raster out of this file.
@@ -2277,42 +3751,31 @@ FME_Status FMECityJSONReader::readRaster(const std::string& fullFileName,
    IFMEFeature* textureFeature = gFMESession->createFeature();
 
    badLuck = newReader->read(*textureFeature, endOfFile);
-   if (badLuck)
-   {
-      gLogFile->silent(oldSilentMode);
-      // TODO: Log some error message
-      return FME_FAILURE;
-   }
-
-   IFMEGeometry* geom = textureFeature->removeGeometry();
-
-   if (!geom->canCastAs<IFMERaster*>())
-   {
-      gLogFile->silent(oldSilentMode);
-      // TODO: Log some warning message
-      raster = nullptr;
-   }
-   else
+   if (!badLuck)
    {
-      // This is what we'll return
-      raster = geom->castAs<IFMERaster*>();
-   }
+      IFMEGeometry* geom = textureFeature->removeGeometry();
 
-   // Close the reader and *ignore* any errors.
-   badLuck = newReader->close();
-   if (badLuck)
-   {
-      gLogFile->silent(oldSilentMode);
-      return badLuck;
+      if (!geom->canCastAs<IFMERaster*>())
+      {
+         // TODO: Log some warning message
+         fmeGeometryTools_->destroyGeometry(geom);
+      }
+      else
+      {
+         // This is what we'll return
+         raster = geom->castAs<IFMERaster*>();
+      }
+      geom = nullptr;
    }
 
    // clean up
    gFMESession->destroyFeature(textureFeature);
    textureFeature = nullptr;
-   gFMESession->destroyReader(newReader);
-   newReader = nullptr;
+
+   // Close the reader so it is ready for the next file, and *ignore* any errors.
+   newReader->close();
 
    gLogFile->silent(oldSilentMode);
-   return FME_SUCCESS;
+   return badLuck ? FME_FAILURE : FME_SUCCESS;
 }
 
@@ -36,6 +36,7 @@
 =============================================================================*/
 
 #include <fmeread.h>
+#include <array>
 #include <fstream>
 #include <string>
 #include <map>
@@ -58,10 +59,18 @@
 #include <imultisolid.h>
 #include <icompositesolid.h>
 
+#include "fmecityjsonbox.h"
+#include "fmecityjsonmappedfile.h"
+#include "fmecityjsonobjectindex.h"
+#include "fmecityjsonparser.h"
+#include "fmecityjsonrtree.h"
+#include "fmecityjsonstreamscanner.h"
+#include "fmecityjsonvertexpool.h"
+
 #include <nlohmann/json.hpp>
 // for convenience
 using json = nlohmann::json;
-using VertexPool3D = std::vector<std::tuple<double, double, double>>;
+using VertexPool3D = FMECityJSONVertexPool;
 using VertexPool2D = std::vector<std::tuple<double, double>>;
 
 // Forward declarations
@@ -133,6 +142,17 @@ public:
    // readSchema()
    FME_Status readSchema(IFMEFeature& feature, FME_Boolean& endOfSchema) override;
 
+   // -----------------------------------------------------------------------
+   // setConstraints()
+   // We support "fme_envelope_intersects", using an R-tree over the CityObjects
+   // that is built the first time it is needed, and "fme_all_features".  Either
+   // one starts reading from the first CityObject again.
+   FME_Status setConstraints(const IFMEFeature& feature) override;
+
+   // -----------------------------------------------------------------------
+   // spatialEnabled()
+   FME_Boolean spatialEnabled() override { return FME_TRUE; }
+
    // -----------------------------------------------------------------------
    // Insert additional public methods here
    // -----------------------------------------------------------------------
@@ -187,10 +207,98 @@ private:
    // Insert additional private methods here
    // -----------------------------------------------------------------------
 
-   void readVertexPool();
+   FME_Status readVertexPool();
+
+   // Apply the "transform" from the file to these vertices.
+   void transformVertices(VertexPool3D& vertices) const;
 
    void scanLODs();
 
+   // The one pass over all the CityObjects when the file is opened.  It fills
+   // objectIndex_ and lodInData_.
+   void indexCityObjects();
+
+   // The optional sidecar cache of objectIndex_ and lodInData_, in <dataset>.cjidx.
+   // The key says which exact file it was made from.  Loading returns false if the
+   // cache isn't there, or isn't for this file.
+   json indexCacheKey() const;
+   bool loadIndexCache(const json& key);
+   void saveIndexCache(const json& key) const;
+
+   // The 2D box of a CityObject, from all of its geometries.  It is empty if
+   // there are none.
+   FMECityJSONBox cityObjectBox(const json& cityObject, const VertexPool3D& vertices) const;
+
+   // The 3D extent of each geometry template, for the boxes of GeometryInstances.
+   void readTemplateExtents();
+
+   // Another pass over all the CityObjects, to add their boxes and relatives to objectIndex_.
+   void indexCityObjectBoxes();
+
+   // Make sure we have the boxes, and build spatialIndex_ from them.
+   void buildSpatialIndex();
+
+   // Decide which CityObjects to read from spatialIndex_ and the search
+   // envelope parameters.  This fills inSearchEnvelope_.
+   void selectCityObjectsInEnvelope();
+
+   // Point back at the first CityObject.
+   void restartReading();
+
+   // Turn typesToRead_ into readType_.
+   void selectCityObjectTypes();
+
+   // Should we read this CityObject, going by what we know from objectIndex_?
+   // This is checked before the CityObject is parsed, when it isn't in memory already.
+   bool wantCityObject(std::size_t objectIndex);
+
+   // Add a single CityObject to objectIndex_ and lodInData_.
+   void indexCityObject(const std::string& objectId, const json& cityObject);
+
+   // Add the LoDs of the geometries of a single CityObject to lodInData_.
+   void scanCityObjectLODs(const std::string& objectId, const json& cityObject);
+
+   // Add the attributes and geometry types of a single CityObject to the summary of its feature type.
+   void addCityObjectToSchema(const json& cityObject, FMECityJSONObjectIndex::FeatureType& featureType);
+
+   // Returns true if none of the geometries of this CityObject have the LoD we want.
+   bool skipCityObjectForLOD(const FMECityJSONObjectIndex::Entry& entry, json& cityObject);
+
+   // Point at the next CityObject to read, and the vertices its geometry uses, whether
+   // it's from the DOM, streamed from the file, or from a CityJSON Text Sequence.
+   // objectIndex is where it is in objectIndex_.  Returns false when there are no more.
+   bool fetchNextCityObject(std::string& objectId,
+                            json*& cityObject,
+                            VertexPool3D*& vertices,
+                            std::size_t& objectIndex);
+
+   // Streaming mode: one pass over the file to read everything but the CityObjects,
+   // and remember where the CityObjects are.
+   FME_Status scanStream();
+
+   // Only reading some CityObjects by id: find them, and the vertices they use,
+   // with a quick structural scan of the file, and parse only those.
+   FME_Status scanForIds();
+
+   // Warn about the vertices that did not have exactly 3 coordinates, if any.
+   void logBadVertices(std::size_t badVertices);
+
+   // Streaming mode: parse a single CityObject from the file.  Logs an error and
+   // returns false if it could not be parsed.
+   bool readCityObjectSpan(const CityObjectSpan& span, json& cityObject);
+
+   // CityJSON Text Sequence mode: find the next non-blank line, starting at position.
+   // Moves position on to the start of the line after it.
+   bool nextSequenceLine(std::size_t& position, std::size_t& lineStart, std::size_t& lineLength) const;
+
+   // CityJSON Text Sequence mode: read the header from the first line.
+   FME_Status readSequenceHeader();
+
+   // CityJSON Text Sequence mode: parse the next CityJSONFeature line, starting at
+   // position.  If vertices is given, it gets the transformed vertices of the line.
+   // Lines we can't read are logged and skipped.  Returns false at the end of the file.
+   bool readSequenceFeature(std::size_t& position, json& feature, VertexPool3D* vertices);
+
    FME_Status readGeometryDefinitions();
 
    void readMetadata();
@@ -199,88 +307,97 @@ private:
 
    FME_Status readTextures();
 
+   // Load texture number textureIndex of the file, the first time it is used,
+   // and return the reference of the appearance that holds it.  If the texture
+   // can't be made, this returns 0.
+   FME_UInt32 getTextureAppearance(int textureIndex);
+
    void readTextureVertices();
 
    FME_Status readRaster(const std::string& fullFileName, IFMERaster*& raster, std::string readerToUse);
 
    // Parse the attributes of a CityObject or metadata and assign it as attributes to the feature.
    // Takes an iterator over a json object. Also need to pass the end of the iterator to know when to stop.
-   static void parseAttributes(IFMEFeature& feature, json::iterator& it, const json::iterator& _end);
+   // If attributesToRead is given, only the attributes named in it are set.
+   static void parseAttributes(IFMEFeature& feature,
+                               json::iterator& it,
+                               const json::iterator& _end,
+                               const std::unordered_set<std::string>* attributesToRead = nullptr);
 
    // Parse a single Geometry of a CityObject
    // If the LOD does not match one selected, a nullptr will be returned
-   IFMEGeometry* parseCityObjectGeometry(json::value_type& currentGeometry,
-                                         VertexPool3D& vertices,
+   IFMEGeometry* parseCityObjectGeometry(const json& currentGeometry,
+                                         const VertexPool3D& vertices,
                                          const std::string& LODToUse,
                                          bool readGeomsForAllLOD);
 
    // Parse a Multi- or CompositeSolid
    template <typename MCSolid>
    void parseMultiCompositeSolid(MCSolid multiCompositeSolid,
-                                 json::value_type& boundaries,
-                                 json::value_type& semantics,
-                                 json::value_type& textureRefs,
-                                 json::value_type& materialRefs,
-                                 VertexPool3D& vertices);
+                                 const json& boundaries,
+                                 const json& semantics,
+                                 const json& textureRefs,
+                                 const json& materialRefs,
+                                 const VertexPool3D& vertices);
 
    // Parse a Solid
-   IFMEBRepSolid* parseSolid(json::value_type& boundaries,
-                             json::value_type& semantics,
-                             json::value_type* semanticSrfVec2,
-                             json::value_type& textureRefs,
-                             json::value_type& materialRefs,
-                             VertexPool3D& vertices);
+   IFMEBRepSolid* parseSolid(const json& boundaries,
+                             const json& semantics,
+                             const json* semanticSrfVec2,
+                             const json& textureRefs,
+                             const json& materialRefs,
+                             const VertexPool3D& vertices);
 
    // Parse a Multi- or CompositeSurface
    template <typename MCSurface>
    void parseMultiCompositeSurface(MCSurface multiCompositeSurface,
-                                   json::value_type& boundaries,
-                                   json::value_type& semantics,
-                                   json::value_type* semanticSrfVec,
-                                   json::value_type& textureRefs,
-                                   json::value_type& materialRefs,
-                                   VertexPool3D& vertices);
-
-   IFMEFace* createOneSurface(json::value_type& textureRefs,
-                              json::value_type& materialRefs,
-                              json::value_type& boundaries,
-                              VertexPool3D& vertices,
-                              json::value_type* semanticSrf);
+                                   const json& boundaries,
+                                   const json& semantics,
+                                   const json* semanticSrfVec,
+                                   const json& textureRefs,
+                                   const json& materialRefs,
+                                   const VertexPool3D& vertices);
+
+   IFMEFace* createOneSurface(const json& textureRefs,
+                              const json& materialRefs,
+                              const json& boundaries,
+                              const VertexPool3D& vertices,
+                              const json* semanticSrf);
 
    // Parse a single Surface of the boundary
-   IFMEFace* parseSurfaceBoundaries(json::value_type& surface,
-                                    VertexPool3D& vertices,
-                                    json::value_type& textureRefs);
+   IFMEFace* parseSurfaceBoundaries(const json& surface,
+                                    const VertexPool3D& vertices,
+                                    const json& textureRefs);
 
    // parse the semantics and attach them to the surface.
-   void parseSemantics(IFMEFace& face, json::value_type* semanticSurface);
+   void parseSemantics(IFMEFace& face, const json* semanticSurface);
 
    // parse the materials and attach them to the surface.
-   void parseMaterials(IFMEFace& face, json::value_type& materialRef);
+   void parseMaterials(IFMEFace& face, const json& materialRef);
 
    // Parse a MultiLineString
    void parseMultiLineString(IFMEMultiCurve* mlinestring,
-                             json::value_type& boundaries,
-                             VertexPool3D& vertices);
+                             const json& boundaries,
+                             const VertexPool3D& vertices);
 
    // Parse a single Ring to an IFMELine
    void parseRings(std::vector<IFMELine*>& rings,
                    std::vector<FME_UInt32>& appearanceRefs,
-                   json::value_type& boundary,
-                   VertexPool3D& vertices,
-                   json::value_type& textureRefs);
+                   const json& boundary,
+                   const VertexPool3D& vertices,
+                   const json& textureRefs);
 
    // Parse a single LineString
    void parseLineString(IFMELine* line,
                         std::optional<FME_UInt32>& appearanceRef,
-                        json::value_type& boundary,
-                        VertexPool3D& vertices,
-                        json::value_type& textureRefs);
+                        const json& boundary,
+                        const VertexPool3D& vertices,
+                        const json& textureRefs);
 
    // Parse MultiPoint geometry
    void parseMultiPoint(IFMEMultiPoint* mpoint,
-                        json::value_type& boundary,
-                        VertexPool3D& vertices);
+                        const json& boundary,
+                        const VertexPool3D& vertices);
 
    // Set the Level of Detail Trait on the geometry
    static void setTraitString(IFMEGeometry& geometry,
@@ -289,7 +406,7 @@ private:
 
    // Cast the geometry LoD to a string, even though the specs require a number.
    // Because strings are easier to compare than floats (in case of extended LoD).
-   static std::string lodToString(json currentGeometry);
+   static std::string lodToString(const json& currentGeometry);
 
    // -----------------------------------------------------------------------
    // If the reader is being used as a "helper" to the writer, to gather
@@ -298,8 +415,8 @@ private:
    FME_Status fetchSchemaFeaturesForWriter();
 
    // -----------------------------------------------------------------------
-   json::value_type* fetchSemanticsValues(json::value_type& semantics);
-   json::value_type* fetchSemanticsValues(json::value_type& semanticsArray, std::size_t index);
+   static const json* fetchSemanticsValues(const json& semantics);
+   static const json* fetchSemanticsValues(const json& semanticsArray, std::size_t index);
 
    // Data members
 
@@ -334,7 +451,7 @@ private:
    // Insert additional private data members here
    // -----------------------------------------------------------------------
 
-   std::ifstream inputFile_;
+   FMECityJSONMappedFile inputFile_;
    json inputJSON_;
    json metaObject_; // for storing the metadata object
    json::iterator nextObject_;
@@ -345,8 +462,38 @@ private:
    std::map<int, FME_UInt32> materialsMap_;
    std::string defaultThemeMaterial_;
    std::map<int, FME_UInt32> texturesMap_;
+   std::map<std::string, IFMEUniversalReader*> rasterReaders_; // one per raster format
    std::string defaultThemeTexture_;
    std::vector<std::string> lodInData_;
+
+   // What we found out about each CityObject when the file was opened.
+   FMECityJSONObjectIndex objectIndex_;
+   std::size_t nextObjectIndex_;
+   std::int32_t lodParamId_; // lodParam_ in objectIndex_
+   bool useIndexCache_;
+   bool indexCacheFullHash_; // hash all of the file for the cache key, not just a sample
+
+   // If not empty, these are the only CityObjects we read.
+   std::unordered_set<std::string> idsToRead_;
+
+   // If not empty, we only read CityObjects of these types, and only these attributes.
+   std::unordered_set<std::string> typesToRead_;
+   std::unordered_set<std::string> attributesToRead_;
+   std::vector<bool> readType_; // for each type in objectIndex_
+
+   // The search envelope, if we were given one, and what to do with the
+   // CityObjects that have no geometry, and the relatives of the ones inside it.
+   FMECityJSONBox searchEnvelope_;
+   bool envelopeReadsNoGeometry_;
+   bool envelopeReadsRelatives_;
+   std::vector<std::array<double, 6>> templateExtents_; // min x/y/z, max x/y/z
+   std::vector<bool> inSearchEnvelope_;                 // one for each entry in objectIndex_
+   int skippedOutsideEnvelope_;
+
+   // The boxes of the CityObjects, for searching, and the CityObjects that have no box.
+   FMECityJSONRTree spatialIndex_;
+   std::vector<std::size_t> objectsWithoutBox_;
+   bool spatialIndexBuilt_;
    std::map<std::pair<FME_UInt32, FME_UInt32>, FME_UInt32> matTexMap_;
 
    // Let's track things so we don't log so much.
@@ -359,11 +506,44 @@ private:
    IFMEString* textureCoordUName_;
    IFMEString* textureCoordVName_;
 
+   // Scratch space for the coordinates of the line parseLineString() is building.
+   // They're kept around so we don't allocate them again for every ring.  The
+   // X, Y and Z are only needed with FME_CITYJSON_LINE_ARRAYS.
+   std::vector<FME_Real64> ringX_;
+   std::vector<FME_Real64> ringY_;
+   std::vector<FME_Real64> ringZ_;
+   std::vector<FME_Real64> ringU_;
+   std::vector<FME_Real64> ringV_;
+
    // These are when the reader is used as a "helper" to the writer
    bool writerHelperMode_;
    std::string writerStartingSchema_;
 
    std::unordered_set<std::string> invalidAttributeValueTypesLogged_;
+
+   // When streaming, inputJSON_ holds everything except the CityObjects, and we
+   // only keep the CityObject we are currently reading.
+   bool streamCityObjects_;
+   std::vector<CityObjectSpan> cityObjectSpans_;
+   std::size_t nextSpan_;
+   json currentCityObject_;
+
+   // The transform from the file, which the vertices of each CityJSONFeature need too.
+   std::vector<double> transformScale_;
+   std::vector<double> transformTranslation_;
+
+   // When reading a CityJSON Text Sequence, inputJSON_ holds the header line and we
+   // only keep the CityJSONFeature line we are currently reading.
+   bool sequenceMode_;
+   std::size_t sequenceStart_;
+   std::size_t nextLinePosition_;
+   json currentFeature_;
+   json::iterator nextFeatureObject_;
+   VertexPool3D featureVertices_;
+
+   // Which JSON parser to use, see fmecityjsonparser.h
+   std::string parserParam_;
+   std::unique_ptr<FMECityJSONParser> parser_;
 };
 
 #endif
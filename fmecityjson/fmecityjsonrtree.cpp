@@ -0,0 +1,178 @@
+/*=============================================================================
+
+   Name     : fmecityjsonrtree.cpp
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Implementation of FMECityJSONRTree
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+// Include Files
+#include "fmecityjsonrtree.h"
+
+#include "fmecityjsonvertexpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace
+{
+   //===========================================================================
+   double centreX(const FMECityJSONBox& box) { return box.minX + (box.maxX - box.minX) / 2; }
+   double centreY(const FMECityJSONBox& box) { return box.minY + (box.maxY - box.minY) / 2; }
+
+   //===========================================================================
+   // Put the boxes (and their items) in Sort-Tile-Recursive order.
+   void sortTileRecursive(std::vector<std::pair<FMECityJSONBox, std::size_t>>& boxes)
+   {
+      const std::size_t nodeSize = FMECityJSONRTree::kNodeSize;
+      const std::size_t numNodes = (boxes.size() + nodeSize - 1) / nodeSize;
+      const std::size_t numSlices =
+         std::max<std::size_t>(1, std::size_t(std::ceil(std::sqrt(double(numNodes)))));
+      const std::size_t sliceSize = numSlices * nodeSize;
+
+      std::sort(boxes.begin(), boxes.end(), [](const auto& a, const auto& b) {
+         return centreX(a.first) < centreX(b.first);
+      });
+
+      // The slices don't overlap, so each one can be sorted on its own.  A chunk
+      // sorts the slices that start inside it.
+      forEachChunk(boxes.size(), [&](std::size_t begin, std::size_t end) {
+         for (std::size_t start = (begin + sliceSize - 1) / sliceSize * sliceSize; start < end;
+              start += sliceSize)
+         {
+            const std::size_t stop = std::min(start + sliceSize, boxes.size());
+            std::sort(boxes.begin() + start, boxes.begin() + stop, [](const auto& a, const auto& b) {
+               return centreY(a.first) < centreY(b.first);
+            });
+         }
+      });
+   }
+}
+
+//===========================================================================
+void FMECityJSONRTree::clear()
+{
+   items_.clear();
+   levels_.clear();
+}
+
+//===========================================================================
+void FMECityJSONRTree::build(const std::vector<FMECityJSONBox>& boxes)
+{
+   clear();
+
+   std::vector<std::pair<FMECityJSONBox, std::size_t>> leaves;
+   leaves.reserve(boxes.size());
+   for (std::size_t i = 0; i < boxes.size(); ++i)
+   {
+      if (not boxes[i].empty())
+      {
+         leaves.emplace_back(boxes[i], i);
+      }
+   }
+   if (leaves.empty())
+   {
+      return;
+   }
+
+   sortTileRecursive(leaves);
+   items_.reserve(leaves.size());
+   levels_.emplace_back();
+   levels_[0].reserve(leaves.size());
+   for (const auto& [box, item] : leaves)
+   {
+      levels_[0].push_back(box);
+      items_.push_back(item);
+   }
+
+   // Each level above covers the one below, kNodeSize boxes at a time.  The order
+   // of the nodes is what makes the tree good, so they get packed the same way.
+   while (levels_.back().size() > kNodeSize)
+   {
+      const std::vector<FMECityJSONBox>& below = levels_.back();
+      std::vector<FMECityJSONBox> level((below.size() + kNodeSize - 1) / kNodeSize);
+      forEachChunk(level.size(), [&](std::size_t begin, std::size_t end) {
+         for (std::size_t node = begin; node < end; ++node)
+         {
+            const std::size_t stop = std::min((node + 1) * kNodeSize, below.size());
+            for (std::size_t child = node * kNodeSize; child < stop; ++child)
+            {
+               level[node].expand(below[child]);
+            }
+         }
+      });
+      levels_.push_back(std::move(level));
+   }
+}
+
+//===========================================================================
+void FMECityJSONRTree::search(const FMECityJSONBox& window, std::vector<std::size_t>& items) const
+{
+   items.clear();
+   if (empty() or window.empty())
+   {
+      return;
+   }
+
+   // (level, node) pairs still to look inside.  The root level has no parent
+   // node, so we start with all of its boxes.
+   std::vector<std::pair<std::size_t, std::size_t>> toVisit;
+   const std::size_t top = levels_.size() - 1;
+   for (std::size_t i = 0; i < levels_[top].size(); ++i)
+   {
+      toVisit.emplace_back(top, i);
+   }
+
+   while (not toVisit.empty())
+   {
+      const auto [level, node] = toVisit.back();
+      toVisit.pop_back();
+      if (not levels_[level][node].intersects(window))
+      {
+         continue;
+      }
+
+      if (level == 0)
+      {
+         items.push_back(items_[node]);
+         continue;
+      }
+
+      const std::size_t stop = std::min((node + 1) * kNodeSize, levels_[level - 1].size());
+      for (std::size_t child = node * kNodeSize; child < stop; ++child)
+      {
+         toVisit.emplace_back(level - 1, child);
+      }
+   }
+
+   // The items come out in tree order, but we read them in file order.
+   std::sort(items.begin(), items.end());
+}
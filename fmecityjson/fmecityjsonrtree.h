@@ -0,0 +1,75 @@
+#ifndef FME_CITY_JSON_RTREE_H
+#define FME_CITY_JSON_RTREE_H
+/*=============================================================================
+
+   Name     : fmecityjsonrtree.h
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Declaration of FMECityJSONRTree
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+#include <cstddef>
+#include <vector>
+
+#include "fmecityjsonbox.h"
+
+// -----------------------------------------------------------------------
+// A static R-tree over the boxes of the CityObjects, so a search envelope only
+// has to look at the CityObjects near it.  It is packed bottom up with the
+// Sort-Tile-Recursive method: the boxes are sorted into vertical slices by x,
+// each slice is sorted by y, and every run of kNodeSize boxes makes a node.
+// The same is done with the nodes, until there is only one level left.
+// It can't be changed once built, but that's all we need for a file we only read.
+class FMECityJSONRTree
+{
+public:
+   static const std::size_t kNodeSize = 16;
+
+   void clear();
+   bool empty() const { return items_.empty(); }
+
+   // Build the tree over these boxes, where item i has boxes[i].  Empty boxes
+   // are left out, so they are never found.
+   void build(const std::vector<FMECityJSONBox>& boxes);
+
+   // Set items to every item whose box intersects the window, in increasing order.
+   void search(const FMECityJSONBox& window, std::vector<std::size_t>& items) const;
+
+private:
+   // The items, in the order of the leaves.
+   std::vector<std::size_t> items_;
+
+   // levels_[0] has the boxes of the items, in the same order.  Box i of
+   // levels_[k] covers boxes i * kNodeSize .. (i + 1) * kNodeSize - 1 of
+   // levels_[k - 1].  The last level is the root, with no more than kNodeSize boxes.
+   std::vector<std::vector<FMECityJSONBox>> levels_;
+};
+
+#endif
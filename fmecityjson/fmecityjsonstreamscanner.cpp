@@ -0,0 +1,357 @@
+/*=============================================================================
+
+   Name     : fmecityjsonstreamscanner.cpp
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Implementation of FMECityJSONStreamScanner
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+// Include Files
+#include "fmecityjsonstreamscanner.h"
+
+//===========================================================================
+// Constructor
+FMECityJSONStreamScanner::FMECityJSONStreamScanner(json& header,
+                                                   VertexPool3D& vertices,
+                                                   std::vector<CityObjectSpan>& cityObjectSpans,
+                                                   const char* data,
+                                                   const std::size_t& bytesRead)
+   : header_(header),
+     vertices_(vertices),
+     cityObjectSpans_(cityObjectSpans),
+     data_(data),
+     bytesRead_(bytesRead),
+     objectElement_(nullptr),
+     depth_(0),
+     inCityObjects_(false),
+     inVertices_(false),
+     skipStartDepth_(0),
+     currentOffset_(0),
+     coords_{0.0, 0.0, 0.0},
+     numCoords_(0),
+     badVertices_(0)
+{
+}
+
+//===========================================================================
+std::string decodeCityObjectId(std::string_view rawId)
+{
+   if (rawId.find('\\') == std::string_view::npos)
+   {
+      return std::string(rawId);
+   }
+
+   // Let the JSON parser deal with the escapes.
+   std::string quoted;
+   quoted.reserve(rawId.size() + 2);
+   quoted += '"';
+   quoted += rawId;
+   quoted += '"';
+   return json::parse(quoted).get<std::string>();
+}
+
+//===========================================================================
+template <typename Value>
+json* FMECityJSONStreamScanner::handleValue(Value&& v)
+{
+   if (refStack_.empty())
+   {
+      header_ = json(std::forward<Value>(v));
+      return &header_;
+   }
+
+   if (refStack_.back()->is_array())
+   {
+      refStack_.back()->emplace_back(std::forward<Value>(v));
+      return &(refStack_.back()->back());
+   }
+
+   *objectElement_ = json(std::forward<Value>(v));
+   return objectElement_;
+}
+
+//===========================================================================
+void FMECityJSONStreamScanner::addCoordinate(double c)
+{
+   if (numCoords_ < 3)
+   {
+      coords_[numCoords_] = c;
+   }
+   ++numCoords_;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::null()
+{
+   if (ignoring() or inVertices_) return true;
+   handleValue(nullptr);
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::boolean(bool val)
+{
+   if (ignoring() or inVertices_) return true;
+   handleValue(val);
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::number_integer(number_integer_t val)
+{
+   if (ignoring()) return true;
+   if (inVertices_)
+   {
+      addCoordinate(static_cast<double>(val));
+      return true;
+   }
+   handleValue(val);
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::number_unsigned(number_unsigned_t val)
+{
+   if (ignoring()) return true;
+   if (inVertices_)
+   {
+      addCoordinate(static_cast<double>(val));
+      return true;
+   }
+   handleValue(val);
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::number_float(number_float_t val, const string_t& /*s*/)
+{
+   if (ignoring()) return true;
+   if (inVertices_)
+   {
+      addCoordinate(val);
+      return true;
+   }
+   handleValue(val);
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::string(string_t& val)
+{
+   if (ignoring() or inVertices_) return true;
+   handleValue(val);
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::binary(binary_t& /*val*/)
+{
+   // There is no binary data in a JSON text file.
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::start_object(std::size_t /*elements*/)
+{
+   if (skipping())
+   {
+      ++depth_;
+      return true;
+   }
+
+   if (inCityObjects_ and depth_ == 2)
+   {
+      // This is the start of a CityObject.  The parser has just consumed the '{'.
+      currentOffset_ = bytesRead_ - 1;
+      ++depth_;
+      skipStartDepth_ = depth_;
+      return true;
+   }
+
+   refStack_.push_back(handleValue(json::value_t::object));
+   ++depth_;
+
+   if (depth_ == 2 and lastTopLevelKey_ == "CityObjects")
+   {
+      inCityObjects_ = true;
+   }
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::key(string_t& val)
+{
+   if (skipping()) return true;
+
+   if (inCityObjects_ and depth_ == 2)
+   {
+      // This is the id of the next CityObject.  The parser has just consumed the
+      // closing quote, so we walk back to the opening one to get the raw key out of
+      // the file, rather than keeping a copy of it.  Keys with escapes are longer in
+      // the file than the value we were given, so we can't just count back.
+      const std::size_t closingQuote = bytesRead_ - 1;
+      std::size_t openingQuote       = closingQuote - 1 - val.size();
+      while (true)
+      {
+         if (data_[openingQuote] == '"')
+         {
+            // Make sure this quote is not escaped itself.
+            std::size_t backslashes = 0;
+            while (data_[openingQuote - 1 - backslashes] == '\\')
+            {
+               ++backslashes;
+            }
+            if (backslashes % 2 == 0) break;
+         }
+         --openingQuote;
+      }
+      currentId_ = std::string_view(data_ + openingQuote + 1, closingQuote - openingQuote - 1);
+      return true;
+   }
+
+   if (depth_ == 1)
+   {
+      lastTopLevelKey_ = val;
+   }
+   objectElement_ = &(*refStack_.back())[val];
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::end_object()
+{
+   --depth_;
+
+   if (skipping())
+   {
+      if (depth_ < skipStartDepth_)
+      {
+         // This is the end of the CityObject.  The parser has just consumed the '}'.
+         cityObjectSpans_.push_back({currentId_, currentOffset_, bytesRead_ - currentOffset_});
+         skipStartDepth_ = 0;
+      }
+      return true;
+   }
+
+   if (inCityObjects_ and depth_ == 1)
+   {
+      inCityObjects_ = false;
+   }
+   refStack_.pop_back();
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::start_array(std::size_t /*elements*/)
+{
+   if (skipping())
+   {
+      ++depth_;
+      return true;
+   }
+
+   if (inCityObjects_ and depth_ == 2)
+   {
+      // Not a valid CityObject, so we just skip over it.
+      ++depth_;
+      skipStartDepth_ = depth_;
+      return true;
+   }
+
+   if (inVertices_)
+   {
+      // The start of a single vertex.
+      ++depth_;
+      numCoords_ = 0;
+      return true;
+   }
+
+   if (depth_ == 1 and lastTopLevelKey_ == "vertices")
+   {
+      // We leave an empty "vertices" array in the header, the real ones go in the pool.
+      handleValue(json::value_t::array);
+      inVertices_ = true;
+      ++depth_;
+      return true;
+   }
+
+   refStack_.push_back(handleValue(json::value_t::array));
+   ++depth_;
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::end_array()
+{
+   --depth_;
+
+   if (skipping())
+   {
+      if (depth_ < skipStartDepth_)
+      {
+         skipStartDepth_ = 0;
+      }
+      return true;
+   }
+
+   if (inVertices_)
+   {
+      if (depth_ == 1)
+      {
+         inVertices_ = false;
+      }
+      else if (depth_ == 2)
+      {
+         // We still add the broken vertices, so the indices of the others don't shift.
+         if (numCoords_ != 3)
+         {
+            ++badVertices_;
+            for (std::size_t i = numCoords_; i < 3; i++)
+            {
+               coords_[i] = 0.0;
+            }
+         }
+         vertices_.emplace_back(coords_[0], coords_[1], coords_[2]);
+      }
+      return true;
+   }
+
+   refStack_.pop_back();
+   return true;
+}
+
+//===========================================================================
+bool FMECityJSONStreamScanner::parse_error(std::size_t /*position*/,
+                                           const std::string& /*lastToken*/,
+                                           const nlohmann::detail::exception& ex)
+{
+   errorMessage_ = ex.what();
+   return false;
+}
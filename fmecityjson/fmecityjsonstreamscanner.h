@@ -0,0 +1,173 @@
+#ifndef FME_CITY_JSON_STREAM_SCANNER_H
+#define FME_CITY_JSON_STREAM_SCANNER_H
+/*=============================================================================
+
+   Name     : fmecityjsonstreamscanner.h
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Declaration of FMECityJSONStreamScanner
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "fmecityjsonvertexpool.h"
+
+#include <nlohmann/json.hpp>
+// for convenience
+using json = nlohmann::json;
+
+// The location of a single CityObject inside the input file.  We keep only this
+// around while streaming, and parse the CityObject itself when it is needed.
+// The id is a view of the raw key in the file, so it may still contain JSON escapes.
+struct CityObjectSpan
+{
+   std::string_view id;
+   std::size_t offset;
+   std::size_t length;
+};
+
+// -----------------------------------------------------------------------
+// An input iterator over a buffer which counts how many characters the
+// JSON parser has consumed.  This is what lets the scanner know the byte
+// offsets of each CityObject without keeping any of them around.
+class CountingIterator
+{
+public:
+   using iterator_category = std::input_iterator_tag;
+   using value_type        = char;
+   using difference_type   = std::ptrdiff_t;
+   using pointer           = const char*;
+   using reference         = char;
+
+   CountingIterator(const char* it, std::size_t* count) : it_(it), count_(count) {}
+
+   char operator*() const { return *it_; }
+   CountingIterator& operator++()
+   {
+      ++it_;
+      ++(*count_);
+      return *this;
+   }
+   bool operator==(const CountingIterator& other) const { return it_ == other.it_; }
+   bool operator!=(const CountingIterator& other) const { return it_ != other.it_; }
+
+private:
+   const char* it_;
+   std::size_t* count_;
+};
+
+// Turn the raw id of a CityObjectSpan into a real string, undoing any JSON escapes.
+std::string decodeCityObjectId(std::string_view rawId);
+
+// -----------------------------------------------------------------------
+// A SAX handler that does a single pass over a CityJSON file and builds up
+// everything *except* the CityObjects and the vertices as a normal json DOM.
+// The vertices go straight into a flat vertex pool (not yet transformed), and
+// for the CityObjects we only remember where each one is in the file.
+class FMECityJSONStreamScanner : public nlohmann::json_sax<json>
+{
+public:
+   using VertexPool3D = FMECityJSONVertexPool;
+
+   // The data is the whole input file, and the bytesRead counter is the one
+   // the CountingIterator is updating.
+   FMECityJSONStreamScanner(json& header,
+                            VertexPool3D& vertices,
+                            std::vector<CityObjectSpan>& cityObjectSpans,
+                            const char* data,
+                            const std::size_t& bytesRead);
+
+   bool null() override;
+   bool boolean(bool val) override;
+   bool number_integer(number_integer_t val) override;
+   bool number_unsigned(number_unsigned_t val) override;
+   bool number_float(number_float_t val, const string_t& s) override;
+   bool string(string_t& val) override;
+   bool binary(binary_t& val) override;
+   bool start_object(std::size_t elements) override;
+   bool key(string_t& val) override;
+   bool end_object() override;
+   bool start_array(std::size_t elements) override;
+   bool end_array() override;
+   bool parse_error(std::size_t position,
+                    const std::string& lastToken,
+                    const nlohmann::detail::exception& ex) override;
+
+   // If the parse failed, this has the reason.
+   const std::string& errorMessage() const { return errorMessage_; }
+
+   // How many entries in "vertices" did not have exactly 3 coordinates.
+   std::size_t badVertices() const { return badVertices_; }
+
+private:
+   // Add a value to the header DOM at the current position.
+   template <typename Value>
+   json* handleValue(Value&& v);
+
+   // Are we somewhere inside a CityObject we are skipping over?
+   bool skipping() const { return skipStartDepth_ > 0; }
+
+   // Is this value something that does not go into the header DOM?
+   bool ignoring() const { return skipping() or (inCityObjects_ and depth_ == 2); }
+
+   // Add one coordinate to the vertex currently being read.
+   void addCoordinate(double c);
+
+   json& header_;
+   VertexPool3D& vertices_;
+   std::vector<CityObjectSpan>& cityObjectSpans_;
+   const char* data_;
+   const std::size_t& bytesRead_;
+
+   std::vector<json*> refStack_;
+   json* objectElement_;
+
+   // How deep we are in the nested objects/arrays. The root object is depth 1.
+   std::size_t depth_;
+   std::string lastTopLevelKey_;
+   bool inCityObjects_;
+   bool inVertices_;
+   std::size_t skipStartDepth_;
+   std::string_view currentId_;
+   std::size_t currentOffset_;
+
+   double coords_[3];
+   std::size_t numCoords_;
+   std::size_t badVertices_;
+
+   std::string errorMessage_;
+};
+
+#endif
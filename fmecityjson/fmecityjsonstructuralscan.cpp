@@ -0,0 +1,211 @@
+/*=============================================================================
+
+   Name     : fmecityjsonstructuralscan.cpp
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Implementation of the structural JSON scan
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+// Include Files
+#include "fmecityjsonstructuralscan.h"
+
+#include <cstring>
+
+//===========================================================================
+std::size_t skipJSONWhitespace(const char* data, std::size_t size, std::size_t position)
+{
+   while (position < size &&
+          (data[position] == ' ' || data[position] == '\t' || data[position] == '\n' ||
+           data[position] == '\r'))
+   {
+      ++position;
+   }
+   return position;
+}
+
+//===========================================================================
+std::size_t skipJSONValue(const char* data, std::size_t size, std::size_t position)
+{
+   position = skipJSONWhitespace(data, size, position);
+   if (position >= size)
+   {
+      return size + 1;
+   }
+
+   // Numbers, true, false and null just run until the next delimiter.
+   const char first = data[position];
+   if (first != '{' && first != '[' && first != '"')
+   {
+      while (position < size && std::strchr(",]} \t\n\r", data[position]) == nullptr)
+      {
+         ++position;
+      }
+      return position;
+   }
+
+   // Otherwise, count the brackets until they balance, ignoring any inside strings.
+   std::size_t depth(0);
+   bool inString(false);
+   for (; position < size; ++position)
+   {
+      const char c = data[position];
+      if (inString)
+      {
+         if (c == '\\')
+         {
+            ++position; // whatever is escaped can't end the string
+         }
+         else if (c == '"')
+         {
+            inString = false;
+            if (depth == 0)
+            {
+               return position + 1;
+            }
+         }
+      }
+      else if (c == '"')
+      {
+         inString = true;
+      }
+      else if (c == '{' || c == '[')
+      {
+         ++depth;
+      }
+      else if (c == '}' || c == ']')
+      {
+         if (--depth == 0)
+         {
+            return position + 1;
+         }
+      }
+   }
+   return size + 1;
+}
+
+//===========================================================================
+bool scanJSONObjectMembers(const char* data,
+                           std::size_t offset,
+                           std::size_t length,
+                           std::vector<CityObjectSpan>& members)
+{
+   const std::size_t size = offset + length;
+   std::size_t position   = skipJSONWhitespace(data, size, offset);
+   if (position >= size || data[position] != '{')
+   {
+      return false;
+   }
+   position = skipJSONWhitespace(data, size, position + 1);
+   if (position < size && data[position] == '}')
+   {
+      return true;
+   }
+
+   while (position < size && data[position] == '"')
+   {
+      // The key.  We keep it raw, escapes and all.
+      const std::size_t keyEnd = skipJSONValue(data, size, position);
+      if (keyEnd > size)
+      {
+         return false;
+      }
+      const std::string_view key(data + position + 1, keyEnd - position - 2);
+
+      position = skipJSONWhitespace(data, size, keyEnd);
+      if (position >= size || data[position] != ':')
+      {
+         return false;
+      }
+      const std::size_t valueStart = skipJSONWhitespace(data, size, position + 1);
+      const std::size_t valueEnd   = skipJSONValue(data, size, valueStart);
+      if (valueEnd > size)
+      {
+         return false;
+      }
+      members.push_back({key, valueStart, valueEnd - valueStart});
+
+      position = skipJSONWhitespace(data, size, valueEnd);
+      if (position < size && data[position] == '}')
+      {
+         return true;
+      }
+      if (position >= size || data[position] != ',')
+      {
+         return false;
+      }
+      position = skipJSONWhitespace(data, size, position + 1);
+   }
+   return false;
+}
+
+//===========================================================================
+bool scanJSONArrayElements(const char* data,
+                           std::size_t offset,
+                           std::size_t length,
+                           const std::vector<std::size_t>& wanted,
+                           std::vector<std::pair<std::size_t, std::size_t>>& elements)
+{
+   const std::size_t size = offset + length;
+   std::size_t position   = skipJSONWhitespace(data, size, offset);
+   if (position >= size || data[position] != '[')
+   {
+      return false;
+   }
+   ++position;
+
+   std::size_t index(0);
+   auto next = wanted.begin();
+   while (next != wanted.end())
+   {
+      const std::size_t elementStart = skipJSONWhitespace(data, size, position);
+      if (elementStart >= size || data[elementStart] == ']')
+      {
+         return false; // ran out of elements
+      }
+      const std::size_t elementEnd = skipJSONValue(data, size, elementStart);
+      if (elementEnd > size)
+      {
+         return false;
+      }
+      if (index == *next)
+      {
+         elements.emplace_back(elementStart, elementEnd - elementStart);
+         ++next;
+      }
+
+      position = skipJSONWhitespace(data, size, elementEnd);
+      if (position < size && data[position] == ',')
+      {
+         ++position;
+      }
+      ++index;
+   }
+   return true;
+}
@@ -0,0 +1,72 @@
+#ifndef FME_CITY_JSON_STRUCTURAL_SCAN_H
+#define FME_CITY_JSON_STRUCTURAL_SCAN_H
+/*=============================================================================
+
+   Name     : fmecityjsonstructuralscan.h
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Declaration of the structural JSON scan
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+#include "fmecityjsonstreamscanner.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// These find where things are in a JSON text without parsing it.  They only
+// look at brackets, braces and quotes, so they are much faster than a parser,
+// but they don't check that what's in between is valid JSON.  Whatever they
+// find still has to go through the real parser.
+
+// Skip any whitespace starting at position.
+std::size_t skipJSONWhitespace(const char* data, std::size_t size, std::size_t position);
+
+// Find the end of the JSON value starting at position (after any whitespace).
+// Returns size + 1 if the value does not end before the end of the data.
+std::size_t skipJSONValue(const char* data, std::size_t size, std::size_t position);
+
+// Find the members of the JSON object at [offset, offset + length).  Each one
+// gets its raw key, and where its value is.  Returns false if it is not an object.
+bool scanJSONObjectMembers(const char* data,
+                           std::size_t offset,
+                           std::size_t length,
+                           std::vector<CityObjectSpan>& members);
+
+// Find the elements of the JSON array at [offset, offset + length) whose
+// indices are in the sorted list wanted.  Each one gets its (offset, length).
+// Returns false if it is not an array, or it is too short.
+bool scanJSONArrayElements(const char* data,
+                           std::size_t offset,
+                           std::size_t length,
+                           const std::vector<std::size_t>& wanted,
+                           std::vector<std::pair<std::size_t, std::size_t>>& elements);
+
+#endif
@@ -0,0 +1,350 @@
+/*=============================================================================
+
+   Name     : fmecityjsontexturecopier.cpp
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Implementation of FMECityJSONTextureCopier
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+// Include Files
+#include "fmecityjsontexturecopier.h"
+
+#include <iband.h>
+#include <ilibrary.h>
+#include <iraster.h>
+#include <irastertools.h>
+#include <isession.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+//===========================================================================
+bool readImageInfo(const std::string& fileName, ImageFileInfo& info)
+{
+   std::ifstream file(fileName, std::ios::binary);
+   if (!file)
+   {
+      return false;
+   }
+
+   unsigned char header[26];
+   if (!file.read(reinterpret_cast<char*>(header), sizeof(header)))
+   {
+      return false;
+   }
+
+   auto bigEndian16 = [](const unsigned char* p) { return FME_UInt32((p[0] << 8) | p[1]); };
+   auto bigEndian32 = [](const unsigned char* p) {
+      return (FME_UInt32(p[0]) << 24) | (FME_UInt32(p[1]) << 16) | (FME_UInt32(p[2]) << 8) | p[3];
+   };
+
+   // PNG: the signature, and then the IHDR chunk always comes first.
+   static const unsigned char kPNGSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+   if (std::equal(kPNGSignature, kPNGSignature + 8, header))
+   {
+      if (!std::equal(header + 12, header + 16, "IHDR"))
+      {
+         return false;
+      }
+      info.width  = bigEndian32(header + 16);
+      info.height = bigEndian32(header + 20);
+
+      // The colour type says what is in each pixel.
+      switch (header[25])
+      {
+         case 0: info.channels = 1; break;                      // grey
+         case 2: info.channels = 3; break;                      // RGB
+         case 3: info.channels = 1; info.palette = true; break; // palette
+         case 4: info.channels = 2; break;                      // grey and alpha
+         case 6: info.channels = 4; break;                      // RGBA
+         default: return false;
+      }
+      return true;
+   }
+
+   // JPEG: walk the markers until we find a start of frame.
+   if (header[0] != 0xFF || header[1] != 0xD8)
+   {
+      return false;
+   }
+   file.seekg(2);
+   unsigned char marker[4];
+   while (file.read(reinterpret_cast<char*>(marker), 4))
+   {
+      if (marker[0] != 0xFF)
+      {
+         return false;
+      }
+      const unsigned char type = marker[1];
+      const FME_UInt32 length  = bigEndian16(marker + 2);
+
+      // SOF0 - SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+      if (type >= 0xC0 && type <= 0xCF && type != 0xC4 && type != 0xC8 && type != 0xCC)
+      {
+         unsigned char frame[6];
+         if (!file.read(reinterpret_cast<char*>(frame), 6))
+         {
+            return false;
+         }
+         info.height   = bigEndian16(frame + 1);
+         info.width    = bigEndian16(frame + 3);
+         info.channels = frame[5];
+         return true;
+      }
+      if (length < 2)
+      {
+         return false;
+      }
+      file.seekg(length - 2, std::ios::cur);
+   }
+   return false;
+}
+
+//===========================================================================
+bool getUnchangedSourceFile(const IFMERaster& raster,
+                            IFMESession& session,
+                            std::string& fileName,
+                            std::string& fileType)
+{
+   IFMEString* value = session.createString();
+   raster.getSourceFormatName(*value);
+   const std::string sourceFormat(value->data(), value->length());
+   raster.getSourceDataset(*value);
+   fileName.assign(value->data(), value->length());
+   session.destroyString(value);
+
+   if (sourceFormat == "JPEG")
+   {
+      fileType = "JPG";
+   }
+   else if (sourceFormat == "PNGRASTER")
+   {
+      fileType = "PNG";
+   }
+   else
+   {
+      return false;
+   }
+
+   ImageFileInfo info;
+   if (fileName.empty() || !readImageInfo(fileName, info))
+   {
+      return false;
+   }
+   if ((info.width != raster.getNumCols()) || (info.height != raster.getNumRows()))
+   {
+      return false;
+   }
+
+   // FME reads each colour component into its own band, and a palette image
+   // into a single band with the palette on it.  Anything else means the
+   // raster was taken apart or put together differently along the way.
+   if (raster.getNumBands() != info.channels)
+   {
+      return false;
+   }
+   for (FME_UInt32 i = 0; i < raster.getNumBands(); i++)
+   {
+      const IFMEBand* band = raster.getBandConst(i);
+      if (!band || ((band->getNumPalettes() > 0) != info.palette))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+//===========================================================================
+bool getRasterContentKey(IFMERaster& raster, IFMESession& session, std::string& key)
+{
+   IFMERasterTools* rasterTools = session.getRasterTools();
+   if (FME_SUCCESS != rasterTools->resolvePalettes(&raster))
+   {
+      return false;
+   }
+
+   const FME_UInt32 numRows = raster.getNumRows();
+   const FME_UInt32 numCols = raster.getNumCols();
+   key = std::to_string(numCols) + 'x' + std::to_string(numRows);
+
+   std::uint64_t hash = 0xcbf29ce484222325ULL;
+   for (FME_UInt32 i = 0; i < raster.getNumBands(); i++)
+   {
+      const IFMEBand* band = raster.getBandConst(i);
+      if (!band)
+      {
+         return false;
+      }
+      const FME_Interpretation interpretation = band->getPropertiesConst().getInterpretation();
+      key += " band " + std::to_string(int(interpretation));
+
+      // A row at a time, so we never hold more than that.
+      IFMETile* tile = rasterTools->createTile(interpretation, 1, numCols);
+      if (!tile)
+      {
+         return false;
+      }
+      bool gotRows(true);
+      for (FME_UInt32 row = 0; gotRows && row < numRows; row++)
+      {
+         gotRows = (FME_SUCCESS == band->getTile(row, 0, *tile));
+         const unsigned char* data = static_cast<const unsigned char*>(tile->getDataConst());
+         const FME_UInt32 size     = tile->getDataSizeInBytes();
+         for (FME_UInt32 j = 0; gotRows && j < size; j++)
+         {
+            hash = (hash ^ data[j]) * 0x100000001b3ULL;
+         }
+      }
+      rasterTools->destroyTile(tile);
+      if (!gotRows)
+      {
+         return false;
+      }
+   }
+
+   key += " pixels " + std::to_string(hash);
+   return true;
+}
+
+//===========================================================================
+const std::string& lookupRasterContentKey(FME_UInt32 rasterReference,
+                                          IFMESession& session,
+                                          RasterContentKeys& contentKeys)
+{
+   auto found = contentKeys.find(rasterReference);
+   if (found != contentKeys.end())
+   {
+      return found->second;
+   }
+
+   std::string& key = contentKeys[rasterReference];
+   IFMERaster* raster = session.getLibrary()->getRasterCopy(rasterReference);
+   if (raster)
+   {
+      if (!getRasterContentKey(*raster, session, key))
+      {
+         key.clear();
+      }
+      raster->destroy();
+      raster = nullptr;
+   }
+   return key;
+}
+
+//===========================================================================
+// Constructor
+FMECityJSONTextureCopier::FMECityJSONTextureCopier(unsigned int maxThreads)
+   : maxThreads_(maxThreads),
+     finishing_(false)
+{
+   if (maxThreads_ == 0)
+   {
+      // It's mostly waiting on the disk, so a few threads is plenty.
+      maxThreads_ = std::clamp(std::thread::hardware_concurrency(), 1u, 4u);
+   }
+}
+
+//===========================================================================
+// Destructor
+FMECityJSONTextureCopier::~FMECityJSONTextureCopier()
+{
+   finish();
+}
+
+//===========================================================================
+void FMECityJSONTextureCopier::copy(const std::string& source,
+                                    const std::string& destination,
+                                    FME_UInt32 rasterReference)
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back({source, destination, rasterReference});
+
+      // Start up threads as the work comes in, up to our limit.
+      if (threads_.size() < maxThreads_)
+      {
+         threads_.emplace_back(&FMECityJSONTextureCopier::work, this);
+      }
+   }
+   jobReady_.notify_one();
+}
+
+//===========================================================================
+std::vector<FME_UInt32> FMECityJSONTextureCopier::finish()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      finishing_ = true;
+   }
+   jobReady_.notify_all();
+
+   for (std::thread& thread : threads_)
+   {
+      thread.join();
+   }
+   threads_.clear();
+
+   // Ready to go again.
+   std::lock_guard<std::mutex> lock(mutex_);
+   finishing_ = false;
+   std::vector<FME_UInt32> failed;
+   failed.swap(failed_);
+   return failed;
+}
+
+//===========================================================================
+void FMECityJSONTextureCopier::work()
+{
+   while (true)
+   {
+      Job job;
+      {
+         std::unique_lock<std::mutex> lock(mutex_);
+         jobReady_.wait(lock, [this] { return finishing_ || !jobs_.empty(); });
+         if (jobs_.empty())
+         {
+            return; // finishing, and nothing left to do
+         }
+         job = std::move(jobs_.front());
+         jobs_.pop_front();
+      }
+
+      std::error_code error;
+      std::filesystem::create_directories(std::filesystem::path(job.destination).parent_path(), error);
+      const bool copied = std::filesystem::copy_file(
+         job.source, job.destination, std::filesystem::copy_options::overwrite_existing, error);
+      if (!copied || error)
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         failed_.push_back(job.rasterReference);
+      }
+   }
+}
@@ -0,0 +1,139 @@
+#ifndef FME_CITY_JSON_TEXTURE_COPIER_H
+#define FME_CITY_JSON_TEXTURE_COPIER_H
+/*=============================================================================
+
+   Name     : fmecityjsontexturecopier.h
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Declaration of FMECityJSONTextureCopier
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+#include <fmetypes.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What the header of a PNG or JPEG file says about the image.
+struct ImageFileInfo
+{
+   FME_UInt32 width    = 0;
+   FME_UInt32 height   = 0;
+   FME_UInt32 channels = 0;     // colour components, counting alpha
+   bool palette        = false; // the pixels are indices into a palette
+};
+
+// Read the header of a PNG or JPEG file, without decoding the image.  Returns
+// false if it is neither, or we can't tell.
+bool readImageInfo(const std::string& fileName, ImageFileInfo& info);
+
+class IFMERaster;
+class IFMESession;
+
+// If the raster looks like it is still exactly the PNG or JPEG file it was read
+// from, get the name of that file and its type ("PNG" or "JPG").  A raster that
+// was changed along the way can keep its source dataset, so the size, the
+// number of bands and the palette have to match the file too.  Even then we
+// can't see the pixels, so only use this when the user told us the textures
+// aren't edited.
+bool getUnchangedSourceFile(const IFMERaster& raster,
+                            IFMESession& session,
+                            std::string& fileName,
+                            std::string& fileType);
+
+// A key that is the same for rasters with the same size, band formats and
+// pixels, wherever they came from: the dimensions, the interpretation of each
+// band, and a 64-bit (FNV-1a) hash of the band data.  Palettes are resolved
+// first, so the colours count rather than the indices.  The raster is our own
+// copy, which this changes.  Returns false if we couldn't read the pixels.
+bool getRasterContentKey(IFMERaster& raster, IFMESession& session, std::string& key);
+
+// Working out the key means reading every pixel, so the geometry visitor and
+// the writer share the keys, by raster reference.  An empty key means we
+// couldn't work it out.
+using RasterContentKeys = std::map<FME_UInt32, std::string>;
+
+// Get the content key of a raster, working it out the first time we're asked.
+const std::string& lookupRasterContentKey(FME_UInt32 rasterReference,
+                                          IFMESession& session,
+                                          RasterContentKeys& contentKeys);
+
+// -----------------------------------------------------------------------
+// Copies texture files into the output textures folder on a few worker threads.
+// When a texture is still exactly the file it was read from, and in the format
+// we want to write, copying the file is all we need to do.  That does not touch
+// any FME objects, so unlike decoding and encoding the raster through FME, it
+// can happen in the background while we carry on.
+class FMECityJSONTextureCopier
+{
+public:
+   // Use at most maxThreads threads (0 means pick based on the hardware).
+   explicit FMECityJSONTextureCopier(unsigned int maxThreads = 0);
+   ~FMECityJSONTextureCopier();
+
+   // Queue a copy.  The rasterReference is only there so the caller knows
+   // which copies failed.
+   void copy(const std::string& source, const std::string& destination, FME_UInt32 rasterReference);
+
+   // Wait for all the queued copies to be done.  Returns the raster
+   // references of the ones that failed.
+   std::vector<FME_UInt32> finish();
+
+private:
+   // Copy constructor
+   FMECityJSONTextureCopier(const FMECityJSONTextureCopier&);
+
+   // Assignment operator
+   FMECityJSONTextureCopier& operator=(const FMECityJSONTextureCopier&);
+
+   void work();
+
+   struct Job
+   {
+      std::string source;
+      std::string destination;
+      FME_UInt32 rasterReference;
+   };
+
+   unsigned int maxThreads_;
+   std::mutex mutex_;
+   std::condition_variable jobReady_;
+   std::deque<Job> jobs_;
+   std::vector<std::thread> threads_;
+   std::vector<FME_UInt32> failed_;
+   bool finishing_;
+};
+
+#endif
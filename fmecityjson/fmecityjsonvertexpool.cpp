@@ -0,0 +1,231 @@
+/*=============================================================================
+
+   Name     : fmecityjsonvertexpool.cpp
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Implementation of FMECityJSONVertexPool
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+// Include Files
+#include "fmecityjsonvertexpool.h"
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+   // Below this, starting threads costs more than it saves.
+   const std::size_t kMinChunkSize = 1 << 18;
+
+   //===========================================================================
+   // values[i] = values[i] * scale + translate, over [begin, end).
+   // The multiply and add are kept separate (no fused multiply-add) so that
+   // every build gives exactly the same coordinates.
+   void scaleAndTranslate(double* values, std::size_t begin, std::size_t end,
+                          double scale, double translate)
+   {
+      std::size_t i = begin;
+#if defined(__AVX2__)
+      const __m256d s = _mm256_set1_pd(scale);
+      const __m256d t = _mm256_set1_pd(translate);
+      for (; i + 4 <= end; i += 4)
+      {
+         __m256d v = _mm256_loadu_pd(values + i);
+         _mm256_storeu_pd(values + i, _mm256_add_pd(_mm256_mul_pd(v, s), t));
+      }
+#endif
+      for (; i < end; ++i)
+      {
+         values[i] = values[i] * scale + translate;
+      }
+   }
+}
+
+//===========================================================================
+void forEachChunk(std::size_t count, const std::function<void(std::size_t, std::size_t)>& work)
+{
+   const std::size_t numThreads =
+      std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                            count / kMinChunkSize);
+   if (numThreads <= 1)
+   {
+      work(0, count);
+      return;
+   }
+
+   // An exception can't leave a thread, so we hold on to it for later.
+   const std::size_t chunkSize = (count + numThreads - 1) / numThreads;
+   std::vector<std::exception_ptr> errors(numThreads);
+   auto runChunk = [&](std::size_t chunk)
+   {
+      try
+      {
+         work(chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+      }
+      catch (...)
+      {
+         errors[chunk] = std::current_exception();
+      }
+   };
+
+   // The calling thread does the last chunk itself.
+   std::vector<std::thread> threads;
+   for (std::size_t chunk = 0; chunk + 1 < numThreads; ++chunk)
+   {
+      threads.emplace_back(runChunk, chunk);
+   }
+   runChunk(numThreads - 1);
+
+   for (std::thread& thread : threads)
+   {
+      thread.join();
+   }
+   for (const std::exception_ptr& error : errors)
+   {
+      if (error)
+      {
+         std::rethrow_exception(error);
+      }
+   }
+}
+
+//===========================================================================
+FMECityJSONVertexPool::FMECityJSONVertexPool()
+:
+   quantized_(true),
+   scale_{1.0, 1.0, 1.0},
+   translate_{0.0, 0.0, 0.0}
+{
+}
+
+//===========================================================================
+void FMECityJSONVertexPool::clear()
+{
+   // Let the memory go, and start again expecting integers.
+   *this = FMECityJSONVertexPool();
+}
+
+//===========================================================================
+void FMECityJSONVertexPool::reserve(std::size_t count)
+{
+   if (quantized_)
+   {
+      qx_.reserve(count);
+      qy_.reserve(count);
+      qz_.reserve(count);
+   }
+   else
+   {
+      x_.reserve(count);
+      y_.reserve(count);
+      z_.reserve(count);
+   }
+}
+
+//===========================================================================
+void FMECityJSONVertexPool::resize(std::size_t count)
+{
+   if (quantized_)
+   {
+      qx_.resize(count);
+      qy_.resize(count);
+      qz_.resize(count);
+   }
+   else
+   {
+      x_.resize(count);
+      y_.resize(count);
+      z_.resize(count);
+   }
+}
+
+//===========================================================================
+void FMECityJSONVertexPool::toDoubles()
+{
+   if (!quantized_)
+   {
+      return;
+   }
+
+   // x() etc. already do the conversion, including any transform so far.
+   const std::size_t count = qx_.size();
+   x_.resize(count);
+   y_.resize(count);
+   z_.resize(count);
+   forEachChunk(count, [&](std::size_t begin, std::size_t end)
+   {
+      for (std::size_t i = begin; i < end; ++i)
+      {
+         x_[i] = x(i);
+         y_[i] = y(i);
+         z_[i] = z(i);
+      }
+   });
+
+   quantized_ = false;
+   qx_ = std::vector<std::int32_t>();
+   qy_ = std::vector<std::int32_t>();
+   qz_ = std::vector<std::int32_t>();
+}
+
+//===========================================================================
+void FMECityJSONVertexPool::transform(const std::vector<double>& scale,
+                                      const std::vector<double>& translate)
+{
+   // Nothing to do for an uncompressed file.  The reader makes sure there are
+   // always 3 of each, but let's not read past the end if there aren't.
+   if (scale.size() != 3 || translate.size() != 3 ||
+       (scale == std::vector<double>{1.0, 1.0, 1.0} && translate == std::vector<double>{0.0, 0.0, 0.0}))
+   {
+      return;
+   }
+
+   // The integers only need to know what transform to use when asked for a vertex.
+   if (quantized_ && scale_[0] == 1.0 && scale_[1] == 1.0 && scale_[2] == 1.0 &&
+       translate_[0] == 0.0 && translate_[1] == 0.0 && translate_[2] == 0.0)
+   {
+      std::copy(scale.begin(), scale.begin() + 3, scale_);
+      std::copy(translate.begin(), translate.begin() + 3, translate_);
+      return;
+   }
+   toDoubles();
+
+   forEachChunk(size(), [&](std::size_t begin, std::size_t end)
+   {
+      scaleAndTranslate(x_.data(), begin, end, scale[0], translate[0]);
+      scaleAndTranslate(y_.data(), begin, end, scale[1], translate[1]);
+      scaleAndTranslate(z_.data(), begin, end, scale[2], translate[2]);
+   });
+}
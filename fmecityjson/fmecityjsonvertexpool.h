@@ -0,0 +1,144 @@
+#ifndef FME_CITY_JSON_VERTEX_POOL_H
+#define FME_CITY_JSON_VERTEX_POOL_H
+/*=============================================================================
+
+   Name     : fmecityjsonvertexpool.h
+
+   System   : FME Plug-in SDK
+
+   Language : C++
+
+   Purpose  : Declaration of FMECityJSONVertexPool
+
+         Copyright (c) 1994 - 2020, Safe Software Inc. All rights reserved.
+
+   Redistribution and use of this sample code in source and binary forms, with
+   or without modification, are permitted provided that the following
+   conditions are met:
+   * Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SAMPLE CODE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+   TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SAMPLE CODE, EVEN IF
+   ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+=============================================================================*/
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// -----------------------------------------------------------------------
+// Run work(begin, end) over [0, count) in chunks spread across a few threads.
+// Small jobs just run on the calling thread.  The work for different chunks
+// must not touch the same data.  If any chunk throws, the first exception is
+// thrown again here once all the threads are done.
+void forEachChunk(std::size_t count, const std::function<void(std::size_t, std::size_t)>& work);
+
+// -----------------------------------------------------------------------
+// The vertices of a CityJSON file, kept as three separate arrays of x, y and z.
+//
+// Compressed files store every coordinate as an integer, with a "transform" to
+// turn them back into real coordinates.  As long as that is what we get, we
+// keep the integers (12 bytes a vertex instead of 24) and apply the transform
+// only when a vertex is asked for.  The first coordinate that isn't an int32
+// turns the pool into plain doubles, and then the transform is applied to all
+// of them up front.  Either way, x(), y() and z() give exactly the same values.
+class FMECityJSONVertexPool
+{
+public:
+   FMECityJSONVertexPool();
+
+   std::size_t size() const { return quantized_ ? qx_.size() : x_.size(); }
+   bool empty() const { return size() == 0; }
+   void clear();
+   void reserve(std::size_t count);
+   void resize(std::size_t count);
+
+   void emplace_back(double x, double y, double z)
+   {
+      if (quantized_)
+      {
+         if (fitsInt32(x) && fitsInt32(y) && fitsInt32(z))
+         {
+            qx_.push_back(std::int32_t(x));
+            qy_.push_back(std::int32_t(y));
+            qz_.push_back(std::int32_t(z));
+            return;
+         }
+         toDoubles();
+      }
+      x_.push_back(x);
+      y_.push_back(y);
+      z_.push_back(z);
+   }
+
+   // Set a vertex that is already there.  Different threads may set different
+   // vertices at the same time, so this never changes how the pool stores
+   // them.  It returns false, and sets nothing, if the pool is keeping
+   // integers and this vertex isn't one.  Call toDoubles() and try again.
+   bool set(std::size_t i, double x, double y, double z)
+   {
+      if (quantized_)
+      {
+         if (!(fitsInt32(x) && fitsInt32(y) && fitsInt32(z)))
+         {
+            return false;
+         }
+         qx_[i] = std::int32_t(x);
+         qy_[i] = std::int32_t(y);
+         qz_[i] = std::int32_t(z);
+         return true;
+      }
+      x_[i] = x;
+      y_[i] = y;
+      z_[i] = z;
+      return true;
+   }
+
+   double x(std::size_t i) const { return quantized_ ? qx_[i] * scale_[0] + translate_[0] : x_[i]; }
+   double y(std::size_t i) const { return quantized_ ? qy_[i] * scale_[1] + translate_[1] : y_[i]; }
+   double z(std::size_t i) const { return quantized_ ? qz_[i] * scale_[2] + translate_[2] : z_[i]; }
+
+   // Apply the CityJSON "transform" to every vertex: v * scale + translate.
+   // Both need exactly 3 values, otherwise nothing is done.
+   void transform(const std::vector<double>& scale, const std::vector<double>& translate);
+
+   // Stop keeping integers, and store every vertex as doubles from now on.
+   void toDoubles();
+
+private:
+   // Is this a value we can keep as an int32 without losing anything?
+   // (Negative zero is not, as the transform could give a different zero.)
+   static bool fitsInt32(double v)
+   {
+      return v >= -2147483648.0 && v <= 2147483647.0 && double(std::int32_t(v)) == v &&
+             !(v == 0.0 && std::signbit(v));
+   }
+
+   bool quantized_;
+   std::vector<std::int32_t> qx_;
+   std::vector<std::int32_t> qy_;
+   std::vector<std::int32_t> qz_;
+   double scale_[3];
+   double translate_[3];
+
+   std::vector<double> x_;
+   std::vector<double> y_;
+   std::vector<double> z_;
+};
+
+#endif
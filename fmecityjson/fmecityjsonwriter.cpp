@@ -62,6 +62,10 @@
 #include <irastertools.h>
 #include <iband.h>
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
 #include <typeinfo>
 #include <iomanip>
 #include <filesystem>
@@ -124,7 +128,14 @@ FMECityJSONWriter::FMECityJSONWriter(const char* writerTypeName, const char* wri
    pretty_print_(false),
    indent_size_(2),
    indent_characters_tabs_(false),
-   uniqueFilenameCounter_(1)
+   uniqueFilenameCounter_(1),
+   sequenceMode_(false),
+   sequenceHeaderWritten_(false),
+   sequenceScale_(1.0),
+   sequenceOrigin_{0, 0, 0},
+   writeIncrementally_(false),
+   copyUnchangedTextures_(false),
+   cityObjectsWritten_(0)
 {
 }
 
@@ -206,16 +217,76 @@ FME_Status FMECityJSONWriter::open(const char* datasetName, const IFMEStringArra
       preferredTextureFormat_ = "";
    }
 
+   //-- write the CityObjects as we go?
+   gMappingFile->fetchWithPrefix(writerKeyword_.c_str(), writerTypeName_.c_str(), kSrcWriteIncrementally, *pv);
+   s1 = pv->data();
+   writeIncrementally_ = false;
+   if (s1.compare("Yes") == 0)
+   {
+      writeIncrementally_ = true;
+   }
+
+   //-- copy the texture files that haven't changed?
+   gMappingFile->fetchWithPrefix(writerKeyword_.c_str(), writerTypeName_.c_str(), kSrcCopyUnchangedTextures, *pv);
+   s1 = pv->data();
+   copyUnchangedTextures_ = false;
+   if (s1.compare("Yes") == 0)
+   {
+      copyUnchangedTextures_ = true;
+   }
+
    gFMESession->destroyString(pv);
 
+   // CityJSON Text Sequences (.jsonl) get a header line, and then one
+   // CityJSONFeature per line.  The vertices must be quantized there, and
+   // each feature carries its own deduplicated vertex list.
+   std::string extension = std::filesystem::path(datasetName).extension().string();
+   std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+   sequenceMode_ = (extension == ".jsonl");
+   sequenceHeaderWritten_ = false;
+   sequenceScale_ = 1 / (pow(10, important_digits_));
+   if (sequenceMode_)
+   {
+      remove_duplicates_ = true;
+
+      // The CityObjects go out one per line anyway.
+      if (writeIncrementally_)
+      {
+         gLogFile->logMessageString("Writing incrementally does not apply to CityJSON Text Sequences and will be ignored.", FME_INFORM);
+         writeIncrementally_ = false;
+      }
+
+      // CityJSONFeature and Text Sequences only came along in CityJSON 1.1,
+      // so readers won't take a sequence that claims to be anything older.
+      sequenceVersion_ = cityjson_version_;
+      int major(0), minor(0);
+      if ((std::sscanf(cityjson_version_.c_str(), "%d.%d", &major, &minor) != 2) ||
+          (major < 1) || ((major == 1) && (minor < 1)))
+      {
+         sequenceVersion_ = kSequenceMinVersion;
+         std::string msg = "CityJSON Text Sequences need CityJSON " + sequenceVersion_ +
+                           " or later, so the file will be written as version " + sequenceVersion_ +
+                           " instead of " + cityjson_version_ + ".";
+         gLogFile->logMessageString(msg.c_str(), FME_INFORM);
+      }
+   }
+
    // Perform setup steps before opening file for writing
 
    // Get geometry tools
    fmeGeometryTools_ = gFMESession->getGeometryTools();
 
    // Create visitor to visit feature geometries
-   visitor_ = new FMECityJSONGeometryVisitor(
-      fmeGeometryTools_, gFMESession, remove_duplicates_, important_digits_, textureRefsToCJIndex_, materialInfoToCJIndex_);
+   // When the vertices end up quantized anyway, the visitor keeps them as
+   // integers from the start.
+   visitor_ = new FMECityJSONGeometryVisitor(fmeGeometryTools_,
+                                             gFMESession,
+                                             remove_duplicates_,
+                                             important_digits_,
+                                             compress_ || sequenceMode_,
+                                             textureRefsToCJIndex_,
+                                             materialInfoToCJIndex_,
+                                             rasterContentKeys_);
 
    dataset_ = datasetName;
 
@@ -284,6 +355,29 @@ FME_Status FMECityJSONWriter::open(const char* datasetName, const IFMEStringArra
    outputJSON_["type"] = "CityJSON";
    outputJSON_["version"] = cityjson_version_;
 
+   // When writing incrementally, the start of the document goes out now, right
+   // up to the opening of the "CityObjects".  JSON does not care about the order
+   // of the members, so everything else can come after them in close().
+   cityObjectsWritten_ = 0;
+   if (writeIncrementally_ && !sequenceMode_)
+   {
+      std::string start = dumpJSON(outputJSON_, 0);
+      start.erase(start.find_last_of('}'));
+      if (pretty_print_)
+      {
+         start.erase(start.find_last_not_of(" \t\n") + 1);
+         start += ",\n" + std::string(indent_size_, indent_characters_tabs_ ? '\t' : ' ') +
+                  "\"CityObjects\": {";
+      }
+      else
+      {
+         start += ",\"CityObjects\":{";
+      }
+      outputFile_ << start;
+      outputJSON_.erase("type");
+      outputJSON_.erase("version");
+   }
+
    return FME_SUCCESS;
 }
 
@@ -312,94 +406,142 @@ FME_Status FMECityJSONWriter::close()
    // Let's write out any vertices we have accumulated from the geometries we
    // have already created.
    std::optional<double> minx, miny, minz, maxx, maxy, maxz;
-   if (visitor_)
+   const QuantizedVertexPool* quantizedVertices = nullptr;
+   if (sequenceMode_)
    {
-      const VertexPool& vtmp = (visitor_)->getGeomVertices();
-      vertices_.insert(vertices_.end(), vtmp.begin(), vtmp.end());
-      visitor_->getGeomBounds(minx, miny, minz, maxx, maxy, maxz);
-   }
+      // All the features, and their appearances, are already out.  We may only
+      // still owe the header if we never got a CityObject.  There is no
+      // document to write after them.
+      if (visitor_)
+      {
+         if (!sequenceHeaderWritten_)
+         {
+            writeSequenceHeader(0.0, 0.0, 0.0);
+         }
 
-   if (!vertices_.empty())
+         // The templates would have to go in the header, which is long gone.
+         if (!visitor_->getTemplateJSON().empty())
+         {
+            gLogFile->logMessageString("Geometry templates cannot be written to a CityJSON Text Sequence.  GeometryInstances will refer to missing templates.", FME_WARN);
+         }
+         gLogFile->logMessageString((kMsgClosingWriter + dataset_).c_str());
+      }
+   }
+   else
    {
-      // Let's update the metadata for the bounds of the actual data.
-      // We may have no vertices or it may all be 2D.  Cover those odd cases.
-      if (minx && miny && maxx && maxy)
+      if (visitor_)
       {
-         std::vector<double> bounds;
+         const VertexPool& vtmp = (visitor_)->getGeomVertices();
+         vertices_.insert(vertices_.end(), vtmp.begin(), vtmp.end());
+         quantizedVertices = &visitor_->getQuantizedGeomVertices();
+         visitor_->getGeomBounds(minx, miny, minz, maxx, maxy, maxz);
+      }
 
-         // not sure if data can be 2D, but let's code it up like it is possible.
-         if (!minz || !maxz)
+      if (!vertices_.empty() || (quantizedVertices && !quantizedVertices->empty()))
+      {
+         // Let's update the metadata for the bounds of the actual data.
+         // We may have no vertices or it may all be 2D.  Cover those odd cases.
+         if (minx && miny && maxx && maxy)
          {
-            bounds.push_back(*minx);
-            bounds.push_back(*miny);
-            bounds.push_back(*maxx);
-            bounds.push_back(*maxy);
+            std::vector<double> bounds;
+
+            // not sure if data can be 2D, but let's code it up like it is possible.
+            if (!minz || !maxz)
+            {
+               bounds.push_back(*minx);
+               bounds.push_back(*miny);
+               bounds.push_back(*maxx);
+               bounds.push_back(*maxy);
+            }
+            else
+            {
+               bounds.push_back(*minx);
+               bounds.push_back(*miny);
+               bounds.push_back(*minz);
+               bounds.push_back(*maxx);
+               bounds.push_back(*maxy);
+               bounds.push_back(*maxz);
+            }
+
+            outputJSON_["metadata"]["geographicalExtent"] = json::array();
+            outputJSON_["metadata"]["geographicalExtent"] = bounds;
+         }
+
+         // Output the actual vertices
+         //-- compress/quantize the file
+         if (compress_ )
+         {
+            compressAndOutputVertices(*quantizedVertices);
          }
          else
          {
-            bounds.push_back(*minx);
-            bounds.push_back(*miny);
-            bounds.push_back(*minz);
-            bounds.push_back(*maxx);
-            bounds.push_back(*maxy);
-            bounds.push_back(*maxz);
+            // Just output them as they are.
+            outputJSON_["vertices"] = vertices_;
          }
-
-         outputJSON_["metadata"]["geographicalExtent"] = json::array();
-         outputJSON_["metadata"]["geographicalExtent"] = bounds;
+         vertices_.clear();
       }
 
-      // Output the actual vertices
-      outputJSON_["vertices"] = json::array();
-      outputJSON_["vertices"] = vertices_;
-      //-- compress/quantize the file
-      if (compress_ )
-      {
-         compressAndOutputVertices(*minx, *miny, *minz);
-      }
-      else
+      // Write out templates, if they exist
+      if (visitor_)
       {
-         // Just output them as they are.
-         outputJSON_["vertices"] = vertices_;
+         const json templates = visitor_->getTemplateJSON();
+         if (!templates.empty())
+         {
+            outputJSON_["geometry-templates"] = templates;
+         } 
       }
-      vertices_.clear();
-   }
-
-   // Write out templates, if they exist
-   if (visitor_)
-   {
-      const json templates = visitor_->getTemplateJSON();
-      if (!templates.empty())
-      {
-         outputJSON_["geometry-templates"] = templates;
-      } 
-   }
 
-   // Write out the appearances
-   FME_Status badLuck = outputAppearances();
-   if (badLuck != FME_SUCCESS) return badLuck;
+      // Write out the appearances
+      FME_Status badLuck = outputAppearances();
+      if (badLuck != FME_SUCCESS) return badLuck;
 
-   //-- write to the file
-   if (!outputJSON_.is_null())
-   {
-      if (pretty_print_)
+      //-- write to the file
+      if (!outputJSON_.is_null())
       {
-         if (indent_characters_tabs_)
+         if (writeIncrementally_)
          {
-            outputFile_ << std::setw(indent_size_) << std::setfill('\t') << outputJSON_ << std::endl;
+            // The CityObjects are already out, so we close them off and add the
+            // rest of the members after them.
+            const char indentChar = indent_characters_tabs_ ? '\t' : ' ';
+            if (pretty_print_)
+            {
+               if (cityObjectsWritten_ > 0)
+               {
+                  outputFile_ << '\n' << std::string(indent_size_, indentChar);
+               }
+            }
+            outputFile_ << '}';
+
+            outputJSON_.erase("CityObjects");
+            std::string rest = dumpJSON(outputJSON_, 0);
+            if (outputJSON_.empty())
+            {
+               outputFile_ << (pretty_print_ ? "\n}" : "}") << std::endl;
+            }
+            else
+            {
+               outputFile_ << ',' << rest.substr(1) << std::endl;
+            }
+         }
+         else if (pretty_print_)
+         {
+            if (indent_characters_tabs_)
+            {
+               outputFile_ << std::setw(indent_size_) << std::setfill('\t') << outputJSON_ << std::endl;
+            }
+            else
+            {
+               outputFile_ << std::setw(indent_size_) << outputJSON_ << std::endl;
+            }
          }
          else
          {
-            outputFile_ << std::setw(indent_size_) << outputJSON_ << std::endl;
+            outputFile_ << outputJSON_ << std::endl;
          }
-      }
-      else
-      {
-         outputFile_ << outputJSON_ << std::endl;
-      }
 
-      // Log that the writer is done
-      gLogFile->logMessageString((kMsgClosingWriter + dataset_).c_str());
+         // Log that the writer is done
+         gLogFile->logMessageString((kMsgClosingWriter + dataset_).c_str());
+      }
    }
    outputJSON_.clear();
 
@@ -890,6 +1032,15 @@ FME_Status FMECityJSONWriter::write(const IFMEFeature& feature)
       }
    }
 
+   if (sequenceMode_)
+   {
+      return writeSequenceFeature(fids);
+   }
+   if (writeIncrementally_)
+   {
+      return writeCityObject(fids);
+   }
+
    return FME_SUCCESS;
 }
 
@@ -1007,6 +1158,14 @@ void FMECityJSONWriter::addDefLineToSchema(const IFMEStringArray& parameters)
 //===========================================================================
 FME_Status FMECityJSONWriter::handleMetadataFeature(const IFMEFeature& feature)
 {
+   // In a CityJSON Text Sequence the metadata lives in the header, and that
+   // went out with the first CityObject.
+   if (sequenceMode_ && sequenceHeaderWritten_)
+   {
+      gLogFile->logMessageString("Metadata features must come before the first CityObject when writing a CityJSON Text Sequence.  This one will be ignored.", FME_WARN);
+      return FME_SUCCESS;
+   }
+
    // TODO:  Right now we will consume as many metadata features as are
    // passed in.  Each one will take their values and overwrite the last.
    // I'm not sure if this is good policy, or if we should reject more than
@@ -1073,24 +1232,194 @@ void FMECityJSONWriter::logFMEStringArray(IFMEStringArray& stringArray)
 }
 
 //===========================================================================
-void FMECityJSONWriter::compressAndOutputVertices(double minx, double miny, double minz)
+void FMECityJSONWriter::compressAndOutputVertices(const QuantizedVertexPool& vertices)
 {
    gLogFile->logMessageString("Compressing/quantizing vertices in the CityJSON object.");
 
-   // We are passed in the offset.  We calculate the scaling factor
-   double scalefactor = 1 / (pow(10, important_digits_));
+   // The visitor already has the vertices as integers, in units of the scale
+   // factor, so all we need to do is move the origin to the minimum corner.
+   const double multiplier  = pow(10, important_digits_);
+   const double scalefactor = 1 / multiplier;
 
-   std::vector<std::array<long long, 3>> vout;
-   for (auto v : vertices_)
+   std::int64_t origin[3] = {std::numeric_limits<std::int64_t>::max(),
+                             std::numeric_limits<std::int64_t>::max(),
+                             std::numeric_limits<std::int64_t>::max()};
+   for (const auto& v : vertices)
    {
-      long long newx = round((std::get<0>(v) - minx) / scalefactor);
-      long long newy = round((std::get<1>(v) - miny) / scalefactor);
-      long long newz = round((std::get<2>(v) - minz) / scalefactor);
-      vout.push_back({newx, newy, newz});
+      for (int i = 0; i < 3; i++)
+      {
+         if (v[i] != kQuantizedNaN && v[i] < origin[i]) origin[i] = v[i];
+      }
+   }
+   for (int i = 0; i < 3; i++)
+   {
+      // If it is all 2D, there won't be any Z.
+      if (origin[i] == std::numeric_limits<std::int64_t>::max()) origin[i] = 0;
+   }
+
+   outputJSON_["vertices"] = json::array();
+   json::array_t& vout = outputJSON_["vertices"].get_ref<json::array_t&>();
+   vout.reserve(vertices.size());
+   for (const auto& v : vertices)
+   {
+      vout.push_back({v[0] - origin[0], v[1] - origin[1], (v[2] == kQuantizedNaN) ? 0 : v[2] - origin[2]});
    }
-   outputJSON_["vertices"]               = vout;
    outputJSON_["transform"]["scale"]     = {scalefactor, scalefactor, scalefactor};
-   outputJSON_["transform"]["translate"] = {minx, miny, minz};
+   outputJSON_["transform"]["translate"] = {dequantizeCoordinate(origin[0], multiplier),
+                                            dequantizeCoordinate(origin[1], multiplier),
+                                            dequantizeCoordinate(origin[2], multiplier)};
+}
+
+//===========================================================================
+void FMECityJSONWriter::writeSequenceHeader(double minx, double miny, double minz)
+{
+   const double multiplier = pow(10, important_digits_);
+
+   // The bounds came from vertices that did fit, so this can only miss by a
+   // hair.  If it does, no translation is always safe.
+   const double mins[3] = {minx, miny, minz};
+   for (int i = 0; i < 3; i++)
+   {
+      if (!quantizeCoordinate(mins[i], multiplier, sequenceOrigin_[i]))
+      {
+         sequenceOrigin_[i] = 0;
+      }
+   }
+
+   // Whatever metadata we have gathered so far goes in with the header.
+   json header;
+   header["type"]                  = "CityJSON";
+   header["version"]               = sequenceVersion_;
+   header["transform"]["scale"]    = {sequenceScale_, sequenceScale_, sequenceScale_};
+   header["transform"]["translate"] = {dequantizeCoordinate(sequenceOrigin_[0], multiplier),
+                                       dequantizeCoordinate(sequenceOrigin_[1], multiplier),
+                                       dequantizeCoordinate(sequenceOrigin_[2], multiplier)};
+   if (outputJSON_.contains("metadata"))
+   {
+      header["metadata"] = outputJSON_["metadata"];
+   }
+   header["CityObjects"]           = json::object();
+   header["vertices"]              = json::array();
+
+   outputFile_ << header << '\n';
+   sequenceHeaderWritten_ = true;
+}
+
+//===========================================================================
+FME_Status FMECityJSONWriter::writeSequenceFeature(const std::string& fids)
+{
+   // The first CityObject decides the translation of the transform, so
+   // the numbers we write stay small.
+   if (!sequenceHeaderWritten_)
+   {
+      std::optional<double> minx, miny, minz, maxx, maxy, maxz;
+      visitor_->getGeomBounds(minx, miny, minz, maxx, maxy, maxz);
+      writeSequenceHeader(minx.value_or(0.0), miny.value_or(0.0), minz.value_or(0.0));
+   }
+
+   // NOTE: each CityObject becomes its own CityJSONFeature, even if it is
+   // the child of another one.  We don't know if (or when) the rest of the
+   // family will arrive, and we don't want to hold on to anything.
+   json featureJSON;
+   featureJSON["type"]        = "CityJSONFeature";
+   featureJSON["id"]          = fids;
+   featureJSON["CityObjects"] = std::move(outputJSON_["CityObjects"]);
+   outputJSON_.erase("CityObjects");
+
+   // The visitor keeps the vertices quantized in this mode, so we only need
+   // to move them to the origin in the header.
+   const QuantizedVertexPool& vtmp = visitor_->getQuantizedGeomVertices();
+   featureJSON["vertices"] = json::array();
+   json::array_t& vout = featureJSON["vertices"].get_ref<json::array_t&>();
+   vout.reserve(vtmp.size());
+   for (const auto& v : vtmp)
+   {
+      vout.push_back({v[0] - sequenceOrigin_[0],
+                      v[1] - sequenceOrigin_[1],
+                      (v[2] == kQuantizedNaN) ? 0 : v[2] - sequenceOrigin_[2]});
+   }
+
+   // The textures and materials are only the ones this feature uses, so
+   // the appearance goes along with it.
+   FME_Status badLuck = outputAppearances();
+   if (badLuck != FME_SUCCESS) return badLuck;
+   if (outputJSON_.contains("appearance"))
+   {
+      featureJSON["appearance"] = std::move(outputJSON_["appearance"]);
+      outputJSON_.erase("appearance");
+   }
+
+   // The next feature starts with empty pools again.
+   visitor_->clearGeomVertices();
+
+   outputFile_ << featureJSON << '\n';
+   if (!outputFile_.good())
+   {
+      gLogFile->logMessageString(kMsgWriteError);
+      return FME_FAILURE;
+   }
+
+   return FME_SUCCESS;
+}
+
+//===========================================================================
+FME_Status FMECityJSONWriter::writeCityObject(const std::string& fids)
+{
+   // The key and the value go out by hand, as members of the "CityObjects"
+   // we opened in open().  The object itself is two levels deep.
+   std::string entry = (cityObjectsWritten_ > 0) ? "," : "";
+   if (pretty_print_)
+   {
+      entry += '\n' + std::string(2 * indent_size_, indent_characters_tabs_ ? '\t' : ' ');
+      entry += json(fids).dump() + ": ";
+   }
+   else
+   {
+      entry += json(fids).dump() + ':';
+   }
+   entry += dumpJSON(outputJSON_["CityObjects"][fids], 2);
+   outputJSON_.erase("CityObjects");
+
+   outputFile_ << entry;
+   if (!outputFile_.good())
+   {
+      gLogFile->logMessageString(kMsgWriteError);
+      return FME_FAILURE;
+   }
+   cityObjectsWritten_++;
+
+   return FME_SUCCESS;
+}
+
+//===========================================================================
+std::string FMECityJSONWriter::dumpJSON(const json& value, int depth) const
+{
+   if (!pretty_print_)
+   {
+      return value.dump();
+   }
+
+   const char indentChar = indent_characters_tabs_ ? '\t' : ' ';
+   std::string text = value.dump(indent_size_, indentChar);
+   if (depth > 0)
+   {
+      const std::string newline = '\n' + std::string(depth * indent_size_, indentChar);
+      std::string indented;
+      indented.reserve(text.size());
+      for (char c : text)
+      {
+         if (c == '\n')
+         {
+            indented += newline;
+         }
+         else
+         {
+            indented += c;
+         }
+      }
+      text.swap(indented);
+   }
+   return text;
 }
 
 //===========================================================================
@@ -1108,6 +1437,21 @@ FME_Status FMECityJSONWriter::writeRaster(FME_UInt32 rasterReference,
                                           std::string& fileName,
                                           std::string& fileType)
 {
+   // Have we already written this one?  Let's check before we do any work on it.
+   auto written = rasterRefsToFileNames_.find(rasterReference);
+   if (written != rasterRefsToFileNames_.end())
+   {
+      if (written->second.empty())
+      {
+         // Storing a null string indicates a failure to write the file.
+         fileName = "missing_raster";
+         return FME_FAILURE;
+      }
+      fileName = written->second;
+      fileType = (std::filesystem::path(fileName).extension() == ".jpg") ? "JPG" : "PNG";
+      return FME_SUCCESS;
+   }
+
    IFMERaster* raster = gFMESession->getLibrary()->getRasterCopy(rasterReference);
 
    // This is a bit confusing, so I'll put a note here:
@@ -1147,6 +1491,30 @@ FME_Status FMECityJSONWriter::writeRaster(FME_UInt32 rasterReference,
       fileType = "JPG";
    }
 
+   // If we've written the same image before, under another raster reference,
+   // there is no need to write it again.  The visitor has usually worked out
+   // what is in it already.
+   std::string contentKey = lookupRasterContentKey(rasterReference, *gFMESession, rasterContentKeys_);
+   if (!contentKey.empty())
+   {
+      contentKey += ' ' + fileType;
+      auto same = rasterContentToFileNames_.find(contentKey);
+      if (same != rasterContentToFileNames_.end())
+      {
+         raster->destroy();
+         raster = nullptr;
+         fileName = same->second;
+         rasterRefsToFileNames_[rasterReference] = fileName;
+         return FME_SUCCESS;
+      }
+   }
+
+   // Can we just copy the file it came from?  We need to know before we change it.
+   std::string sourceFile, sourceType;
+   const bool copySourceFile =
+      copyUnchangedTextures_ && getUnchangedSourceFile(*raster, *gFMESession, sourceFile, sourceType) &&
+      (sourceType == fileType);
+
    // JPEG doesn't like to write palettes, have Alpha band, etc. so we must resolve them here.
    // no need to fix up a raster that is not changing format.
    if ((ofn != "JPEG") && (fileType == "JPG"))
@@ -1171,22 +1539,6 @@ FME_Status FMECityJSONWriter::writeRaster(FME_UInt32 rasterReference,
       }
    }
 
-   if (rasterRefsToFileNames_.find(rasterReference) != rasterRefsToFileNames_.end())
-   {
-      std::string writtenName = rasterRefsToFileNames_[rasterReference];
-      if (writtenName.empty())
-      {
-         // Storing a null string indicates a failure to write the file.
-         fileName = "missing_raster";
-         return FME_FAILURE;
-      }
-      else
-      {
-         fileName = writtenName;
-         return FME_SUCCESS;
-      }
-   }
-
    // We want silent logging during the writing of a texture file.
    FME_Boolean oldSilentMode = gLogFile->getSilent();
    gLogFile->silent(FME_TRUE); // don't forget to set this back to what it was before...
@@ -1211,14 +1563,39 @@ FME_Status FMECityJSONWriter::writeRaster(FME_UInt32 rasterReference,
       basename = fileBaseNameSuggestion;
    }
 
-   // We need to write this raster out using an
-   // FME writer. Let's use the format indicated.
    std::string format = (fileType == "JPG") ? "JPEG" : "PNGRASTER";
-   fileName.clear();
-   FME_Status badLuck = writeWithWriter(raster, basename, format, outputDir, fileName);
+   fileName = getUniqueFilename(basename, (format == "JPEG") ? ".jpg" : ".png");
+   if (!contentKey.empty())
+   {
+      rasterContentToFileNames_[contentKey] = fileName;
+   }
+
+   // If the raster is still the file it came from, in the type we want, there's
+   // no need to decode and encode it again.  The file is copied in the
+   // background, and we'll find out how that went in outputAppearances().
+   if (copySourceFile)
+   {
+      raster->destroy();
+      raster = nullptr;
+      rasterRefsToFileNames_[rasterReference] = fileName;
+      textureCopier_.copy(sourceFile, outputDir + '/' + fileName, rasterReference);
+      gLogFile->silent(oldSilentMode);
+      return FME_SUCCESS;
+   }
+
+   // We need to write this raster out using an
+   // FME writer. Let's use the format indicated.  This has to stay on this
+   // thread: the raster, the raster tools and the writer all belong to the
+   // FME session, which can't be used from the copier's threads.
+   FME_Status badLuck = writeWithWriter(raster, format, outputDir, fileName);
    raster = nullptr;
 
-   rasterRefsToFileNames_[rasterReference] = fileName;
+   // Storing a null string indicates a failure to write the file.
+   rasterRefsToFileNames_[rasterReference] = (badLuck == FME_SUCCESS) ? fileName : "";
+   if (badLuck != FME_SUCCESS && !contentKey.empty())
+   {
+      rasterContentToFileNames_.erase(contentKey);
+   }
 
    gLogFile->silent(oldSilentMode);
 
@@ -1227,10 +1604,9 @@ FME_Status FMECityJSONWriter::writeRaster(FME_UInt32 rasterReference,
 
 //------------------------------------------------------------------------------
 FME_Status FMECityJSONWriter::writeWithWriter(IFMERaster*& raster,
-                                              const std::string& basename,
                                               const std::string& format,
                                               const std::string& outputDir,
-                                              std::string& outputFilename)
+                                              const std::string& outputFilename)
 {
    // Get the correct writer.
    IFMEUniversalWriter* writer = nullptr;
@@ -1265,7 +1641,6 @@ FME_Status FMECityJSONWriter::writeWithWriter(IFMERaster*& raster,
 
       // Place the writer in our dictionary.
       writers_[format] = writer;
-      extensions_[format] = (format == "JPEG") ? ".jpg" : ".png";
    }
 
    // Make a temporary feature.
@@ -1273,8 +1648,6 @@ FME_Status FMECityJSONWriter::writeWithWriter(IFMERaster*& raster,
    feature->setGeometry(raster);
    raster = nullptr;
 
-   // Make a unique name.
-   outputFilename = getUniqueFilename(basename, extensions_[format]);
    feature->setFeatureType(std::filesystem::path(outputFilename).stem().string().c_str());
 
    // Do the writing.
@@ -1296,7 +1669,7 @@ std::string FMECityJSONWriter::getUniqueFilename(const std::string& basename,
    std::string fileName = basename + extension;
 
    // We have to alter the name if we found we used it.
-   if (std::find_if(std::begin(rasterRefsToFileNames_), std::end(rasterRefsToFileNames_), [&](auto&& p){ return p.second == fileName; }) != std::end(rasterRefsToFileNames_))
+   while (!usedFileNames_.insert(fileName).second)
    {
       //basename += "_x";
       fileName = basename + "_" + std::to_string(uniqueFilenameCounter_++) + extension;
@@ -1395,6 +1768,22 @@ FME_Status FMECityJSONWriter::outputAppearances()
          // Add this to our array
          allTextures += textureJSON;
       }
+
+      // Wait for the texture files being copied in the background.  If one of
+      // them didn't work out, we write it the regular way, under the same name.
+      for (FME_UInt32 rasterRef : textureCopier_.finish())
+      {
+         const std::string fileName = rasterRefsToFileNames_[rasterRef];
+         const std::string format =
+            (std::filesystem::path(fileName).extension() == ".jpg") ? "JPEG" : "PNGRASTER";
+
+         const FME_Boolean oldSilentMode = gLogFile->getSilent();
+         gLogFile->silent(FME_TRUE); // don't forget to set this back to what it was before...
+         IFMERaster* raster = gFMESession->getLibrary()->getRasterCopy(rasterRef);
+         FME_Status badLuck = writeWithWriter(raster, format, texturesFullDir, fileName);
+         gLogFile->silent(oldSilentMode);
+         if (badLuck != FME_SUCCESS) return badLuck;
+      }
       
       if (!allTextures.is_null())
       {
@@ -1497,5 +1886,11 @@ FME_Status FMECityJSONWriter::outputAppearances()
       materialInfoToCJIndex_.clear();
    }
 
+   // The indices the visitor remembered for each appearance are gone now too.
+   if (visitor_)
+   {
+      visitor_->clearAppearanceCache();
+   }
+
    return FME_SUCCESS;
 }
@@ -44,6 +44,7 @@
 #include <igeometry.h>
 #include <map>
 #include <set>
+#include <unordered_set>
 #include <iwriter.h>
 
 
@@ -51,6 +52,7 @@
 using json = nlohmann::json;
 
 #include "fmecityjsongeometryvisitor.h"
+#include "fmecityjsontexturecopier.h"
 
 // Forward declarations
 class IFMEFeature;
@@ -168,7 +170,7 @@ private:
    FME_Status handleMetadataFeature(const IFMEFeature& feature);
 
    //-- Used for compressing/quantizing vertices from the CityJSON file
-   void compressAndOutputVertices(double minx, double miny, double minz);
+   void compressAndOutputVertices(const QuantizedVertexPool& vertices);
 
    //---------------------------------------------------------------
    void generateUniqueFID(std::string& fids);
@@ -184,12 +186,11 @@ private:
                           std::string& fileType);
 
    //---------------------------------------------------------------
-   // This consumes the raster on failure
+   // This consumes the raster
    FME_Status writeWithWriter(IFMERaster*& raster,
-                              const std::string& basename,
                               const std::string& format,
                               const std::string& outputDir,
-                              std::string& outputFilename);
+                              const std::string& outputFilename);
 
    //---------------------------------------------------------------
    std::string getUniqueFilename(const std::string& basename,
@@ -198,6 +199,27 @@ private:
    //---------------------------------------------------------------
    FME_Status outputAppearances();
 
+   //---------------------------------------------------------------
+   // CityJSON Text Sequence mode: write the first line of the file, which
+   // holds the metadata and the transform all the features share.
+   void writeSequenceHeader(double minx, double miny, double minz);
+
+   //---------------------------------------------------------------
+   // CityJSON Text Sequence mode: write the CityObject we just built as a
+   // single CityJSONFeature line, with its own vertices and appearance.
+   FME_Status writeSequenceFeature(const std::string& fids);
+
+   //---------------------------------------------------------------
+   // Incremental mode: write the CityObject we just built straight into the
+   // "CityObjects" of the output file, and forget about it.
+   FME_Status writeCityObject(const std::string& fids);
+
+   //---------------------------------------------------------------
+   // Dump some JSON with the formatting options the user asked for.  When
+   // pretty printing, the lines after the first are indented by depth levels,
+   // so it can be placed inside a document we are writing by hand.
+   std::string dumpJSON(const json& value, int depth) const;
+
    // Data members
 
    // The value specified for WRITER_TYPE in the mapping file. It is
@@ -251,6 +273,9 @@ private:
    // for writing rasters
    std::map<FME_UInt32, int> textureRefsToCJIndex_;
    std::map<FME_UInt32, std::string> rasterRefsToFileNames_;
+   std::map<std::string, std::string> rasterContentToFileNames_; // same image, same file
+   RasterContentKeys rasterContentKeys_; // shared with the visitor
+   std::unordered_set<std::string> usedFileNames_;
    int uniqueFilenameCounter_;
 
    // Keeping track of materials in appearances
@@ -258,12 +283,33 @@ private:
 
    // A mapping from format name -> FME writer.
    std::map<std::string, IFMEUniversalWriter*> writers_;
-   std::map<std::string, std::string> extensions_;
+
+   // Texture files we can copy as they are get copied in the background.
+   FMECityJSONTextureCopier textureCopier_;
 
    // option to control output texture file format
    std::string preferredTextureFormat_;
 
    bool alreadyLoggedMissingLod_;
+
+   // When writing a CityJSON Text Sequence (.jsonl), each feature is written
+   // out as soon as we get it, and nothing accumulates in outputJSON_.
+   bool sequenceMode_;
+   bool sequenceHeaderWritten_;
+   double sequenceScale_;
+   std::int64_t sequenceOrigin_[3]; // the translate, quantized
+   std::string sequenceVersion_;    // at least kSequenceMinVersion
+
+   // When writing incrementally, the start of the document goes out in open(),
+   // each CityObject is written as soon as it is complete, and everything else
+   // (vertices, appearance, templates, ...) is added in close().
+   bool writeIncrementally_;
+
+   // Textures that still look like the JPEG or PNG file they were read from
+   // may be copied from that file, rather than encoded again.  We can't tell
+   // if the pixels were edited, so the user has to ask for this.
+   bool copyUnchangedTextures_;
+   FME_UInt64 cityObjectsWritten_;
 };
 
 #endif